@@ -2,6 +2,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 #define M 5
 #define P 3
@@ -14,6 +26,71 @@
 #define TAMANHO_CATEGORIA 15
 #define TAMANHO_STATUS 16
 
+#define REMOCAO_OK 0
+#define REMOCAO_ARVORE_VAZIA 1
+#define REMOCAO_NAO_ENCONTRADA 2
+#define REMOCAO_FALHOU 3
+
+#define FORMATO_FIXO 0
+#define FORMATO_COMPACTO 1
+#define FORMATO_ATUAL -1
+#define COMPACTO_MAGICO "LCD2"
+#define COMPACTO_FOLGA 256
+#define DICT_MODELO_MAX 512
+#define DICT_MARCA_MAX 256
+#define DICT_CATEGORIA_MAX 64
+#define DICT_STATUS_MAX 32
+
+#define EXPORT_TEXTO 0
+#define EXPORT_CSV 1
+#define EXPORT_JSONL 2
+#define EXPORT_BLOCO 2048
+#define EXPORT_MAX_REGISTRO 1024
+#define EXPORT_MAX_THREADS 8
+
+#define MAX_SHARDS 16
+#define SHARD_POR_PREFIXO 0
+#define SHARD_POR_HASH 1
+#define BLOCO_PARTICAO 1024
+
+#define SERVIDOR_SOCKET_PADRAO "locadora.sock"
+#define SERVIDOR_MAX_EVENTOS 64
+#define SCAN_MAX_REGISTROS 256
+#define CARGA_MAX_PROPRIOS 10000
+
+#define OP_BUSCAR 1
+#define OP_INSERIR 2
+#define OP_ATUALIZAR 3
+#define OP_REMOVER 4
+#define OP_VARRER 5
+
+#define OP_RECONSTRUIR 6
+#define OP_RETIRAR 7
+#define OP_DEVOLVER 8
+#define NUM_OPS 9
+
+#define TRACE_MAGICO "LCT2"
+#define TRACE_BUFFER (1 << 20)
+#define TRACE_COM_TEXTO 1
+
+#define RESP_OK 0
+#define RESP_NAO_ENCONTRADO 1
+#define RESP_ERRO 2
+
+#define VERSOES_BUCKETS 1024
+
+#define BUFFER_MENSAGENS 32
+#define MSG_INSERIR 1
+#define MSG_REMOVER 2
+
+#define STATUS_DISPONIVEL "Disponivel"
+#define STATUS_ALUGADO "Alugado"
+#define SITUACAO_OUTRA 0
+#define SITUACAO_DISPONIVEL 1
+#define SITUACAO_ALUGADO 2
+#define POOL_MAGICO "LCP2"
+#define POOL_MAX_CATEGORIAS 64
+
 typedef struct {
     char placa[TAMANHO_PLACA];
     char modelo[TAMANHO_MODELO];
@@ -24,6 +101,66 @@ typedef struct {
     char status[TAMANHO_STATUS];
 } Veiculo;
 
+// Formato compacto de veiculos.dat: cabecalho com os dicionarios seguido de
+// registros de tamanho fixo, entao o RRN continua enderecando direto.
+// No arquivo o cabecalho guarda so o usado: magico, contagens, base e as
+// strings terminadas em '\0'. Os registros comecam em 'base', que deixa
+// COMPACTO_FOLGA bytes para o dicionario crescer.
+typedef struct CompactHeader {
+    char magico[4];
+    int num_modelos;
+    int num_marcas;
+    int num_categorias;
+    int num_status;
+    int base;
+    char modelos[DICT_MODELO_MAX][TAMANHO_MODELO];
+    char marcas[DICT_MARCA_MAX][TAMANHO_MARCA];
+    char categorias[DICT_CATEGORIA_MAX][TAMANHO_CATEGORIA];
+    char status[DICT_STATUS_MAX][TAMANHO_STATUS];
+} CompactHeader;
+
+typedef struct CompactVeiculo {
+    char placa[TAMANHO_PLACA - 1];
+    uint8_t categoria;
+    uint16_t modelo;
+    uint16_t marca;
+    uint16_t ano;
+    uint8_t status;
+    uint8_t reservado;
+    uint32_t quilometragem;
+} CompactVeiculo;
+
+// Cabecalho de requisicao e resposta do protocolo binario. Payload:
+// buscar/remover = placa; inserir/atualizar = Veiculo; varrer = placa + uint16 limite;
+// retirar = categoria (responde o Veiculo alugado); devolver = placa
+typedef struct MensagemCabecalho {
+    uint32_t id;
+    uint8_t op;
+    uint8_t status;
+    uint16_t tamanho;
+} MensagemCabecalho;
+
+// Trace: magico, numero de shards e modo, seguidos dos registros. Cada
+// registro e um cabecalho seguido de 'tamanho' bytes de argumento (placa,
+// Veiculo ou placa + limite, conforme a operacao). Os dados de cada shard no
+// inicio da gravacao ficam em <trace>.s<N>.dat. TRACE_COM_TEXTO em 'marcas'
+// indica a remocao do menu, que tambem reescreve o veiculos.txt do shard.
+typedef struct TraceCabecalho {
+    uint64_t timestamp_ns;
+    uint32_t duracao_us;
+    uint8_t op;
+    uint8_t marcas;
+    uint16_t tamanho;
+} TraceCabecalho;
+
+typedef struct TraceRecorder {
+    FILE *arquivo;
+    char *buffer;
+    pthread_mutex_t trava;
+    double inicio;
+    long registros;
+} TraceRecorder;
+
 typedef struct BTreeNode {
     char keys[MAX_KEYS][TAMANHO_PLACA];
     int rrns[MAX_KEYS];
@@ -46,6 +183,86 @@ typedef struct PageQueue {
     int size;
 } PageQueue;
 
+// Copia de uma pagina feita antes de uma escrita, para snapshots abertos.
+// As versoes de um RRN formam uma cadeia da mais nova para a mais antiga
+// (next); as cabecas das cadeias de um mesmo balde ligam-se por proximo_rrn.
+typedef struct PageVersion {
+    int rrn;
+    int epoch;
+    BTreeNode page;
+    struct PageVersion *next;
+    struct PageVersion *proximo_rrn;
+} PageVersion;
+
+typedef struct RecordVersion {
+    int rrn;
+    int epoch;
+    Veiculo veiculo;
+    struct RecordVersion *next;
+    struct RecordVersion *proximo_rrn;
+} RecordVersion;
+
+// Mensagem pendente no buffer de um no interno (modo bufferizado).
+// A sequencia cresce por arvore e da a ordem de chegada entre buffers.
+typedef struct Mensagem {
+    char placa[TAMANHO_PLACA];
+    int rrn;
+    int tipo;
+    long sequencia;
+} Mensagem;
+
+typedef struct NodeBuffer {
+    int quantidade;
+    Mensagem mensagens[BUFFER_MENSAGENS];
+} NodeBuffer;
+
+typedef struct BufferCache {
+    NodeBuffer buffers[P];
+    int rrns[P];
+    bool modificados[P];
+    long usos[P];
+    long relogio;
+} BufferCache;
+
+typedef struct PoolCabecalho {
+    char magico[4];
+    int limpo;
+    int num_registros;
+    int num_categorias;
+    char categorias[POOL_MAX_CATEGORIAS][TAMANHO_CATEGORIA];
+    int cabecas[POOL_MAX_CATEGORIAS];
+    int caudas[POOL_MAX_CATEGORIAS];
+    int disponiveis[POOL_MAX_CATEGORIAS];
+} PoolCabecalho;
+
+// Encadeamento do RRN na lista da sua categoria (categoria -1 = fora do pool)
+typedef struct PoolEntrada {
+    int proximo;
+    int anterior;
+    int categoria;
+} PoolEntrada;
+
+typedef struct AvailabilityPool {
+    PoolCabecalho cabecalho;
+    PoolEntrada *entradas;
+    int capacidade;
+    char filename[300];
+} AvailabilityPool;
+
+struct BTree;
+
+// Visao fixa da arvore: raiz, paginas e registros existentes na abertura
+typedef struct Snapshot {
+    struct BTree *tree;
+    int epoch;
+    int root_rrn;
+    int next_rrn;
+    int num_registros;
+    Mensagem *pendentes;
+    int num_pendentes;
+    struct Snapshot *next;
+} Snapshot;
+
 typedef struct BTree {
     FILE *index_file;
     FILE *data_file;
@@ -56,8 +273,40 @@ typedef struct BTree {
     char data_filename[256];
     char text_filename[256];
     PageQueue *page_queue;
+    CompactHeader *dicionario;
+    long leituras_pagina;
+    long escritas_pagina;
+    long leituras_registro;
+    long escritas_registro;
+    pthread_mutex_t trava;
+    int epoch;
+    Snapshot *snapshots;
+    PageVersion *page_versions[VERSOES_BUCKETS];
+    RecordVersion *record_versions[VERSOES_BUCKETS];
+    bool bufferizado;
+    FILE *buffer_file;
+    char buffer_filename[300];
+    BufferCache *buffer_cache;
+    long leituras_buffer;
+    long escritas_buffer;
+    long mensagens_pendentes;
+    long proxima_sequencia;
+    bool *buffer_pendente;
+    int buffer_pendente_capacidade;
+    AvailabilityPool *pool;
 } BTree;
 
+// Indice particionado: cada shard tem seus proprios arquivos e sua BTree
+typedef struct ShardedBTree {
+    BTree *shards[MAX_SHARDS];
+    int num_shards;
+    int modo;
+    char config_filename[256];
+    pthread_t backup_thread;
+    bool backup_ativo;
+    TraceRecorder *trace;
+} ShardedBTree;
+
 // Funcoes auxiliares
 void limpar_buffer() {
     int c;
@@ -183,6 +432,274 @@ void queue_add(PageQueue *queue, BTreeNode *page, int rrn) {
     queue->size++;
 }
 
+// Versoes copy-on-write
+Snapshot* cow_latest_snapshot(BTree *tree) {
+    Snapshot *latest = NULL;
+    for (Snapshot *snap = tree->snapshots; snap != NULL; snap = snap->next) {
+        if (latest == NULL || snap->epoch > latest->epoch) {
+            latest = snap;
+        }
+    }
+    return latest;
+}
+
+PageVersion** cow_page_chain(BTree *tree, int rrn) {
+    PageVersion **cadeia = &tree->page_versions[rrn % VERSOES_BUCKETS];
+    while (*cadeia != NULL && (*cadeia)->rrn != rrn) {
+        cadeia = &(*cadeia)->proximo_rrn;
+    }
+    return cadeia;
+}
+
+RecordVersion** cow_record_chain(BTree *tree, int rrn) {
+    RecordVersion **cadeia = &tree->record_versions[rrn % VERSOES_BUCKETS];
+    while (*cadeia != NULL && (*cadeia)->rrn != rrn) {
+        cadeia = &(*cadeia)->proximo_rrn;
+    }
+    return cadeia;
+}
+
+// A versao visivel e a de menor epoch >= a do snapshot; NULL = a atual
+PageVersion* cow_visible_page(BTree *tree, int rrn, int epoch) {
+    PageVersion *visivel = NULL;
+    for (PageVersion *v = *cow_page_chain(tree, rrn); v != NULL && v->epoch >= epoch; v = v->next) {
+        visivel = v;
+    }
+    return visivel;
+}
+
+RecordVersion* cow_visible_record(BTree *tree, int rrn, int epoch) {
+    RecordVersion *visivel = NULL;
+    for (RecordVersion *v = *cow_record_chain(tree, rrn); v != NULL && v->epoch >= epoch; v = v->next) {
+        visivel = v;
+    }
+    return visivel;
+}
+
+// Guarda a imagem atual da pagina antes de ela ser alterada, se algum
+// snapshot aberto ainda puder enxerga-la. Uma versao com epoch >= a do
+// snapshot mais novo ja guarda a imagem que ele ve.
+void cow_preserve_page(BTree *tree, BTreeNode *node, int rrn) {
+    Snapshot *latest = cow_latest_snapshot(tree);
+    if (latest == NULL || rrn >= latest->next_rrn) return;
+    
+    PageVersion **cadeia = cow_page_chain(tree, rrn);
+    PageVersion *mais_nova = *cadeia;
+    if (mais_nova != NULL && mais_nova->epoch >= latest->epoch) return;
+    
+    PageVersion *version = (PageVersion*)malloc(sizeof(PageVersion));
+    version->rrn = rrn;
+    version->epoch = latest->epoch;
+    version->page = *node;
+    version->next = mais_nova;
+    version->proximo_rrn = mais_nova != NULL ? mais_nova->proximo_rrn : NULL;
+    *cadeia = version;
+}
+
+void cow_preserve_record(BTree *tree, Veiculo *veiculo, int rrn) {
+    Snapshot *latest = cow_latest_snapshot(tree);
+    if (latest == NULL || rrn >= latest->num_registros) return;
+    
+    RecordVersion **cadeia = cow_record_chain(tree, rrn);
+    RecordVersion *mais_nova = *cadeia;
+    if (mais_nova != NULL && mais_nova->epoch >= latest->epoch) return;
+    
+    RecordVersion *version = (RecordVersion*)malloc(sizeof(RecordVersion));
+    version->rrn = rrn;
+    version->epoch = latest->epoch;
+    version->veiculo = *veiculo;
+    version->next = mais_nova;
+    version->proximo_rrn = mais_nova != NULL ? mais_nova->proximo_rrn : NULL;
+    *cadeia = version;
+}
+
+// Uma versao com epoch E serve aos snapshots com epoch em (anterior, E],
+// onde anterior e a epoch da versao seguinte (mais antiga) da cadeia
+bool cow_version_needed(BTree *tree, int epoch, int epoch_anterior) {
+    for (Snapshot *snap = tree->snapshots; snap != NULL; snap = snap->next) {
+        if (snap->epoch <= epoch && snap->epoch > epoch_anterior) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void cow_reclaim(BTree *tree) {
+    for (int b = 0; b < VERSOES_BUCKETS; b++) {
+        PageVersion **cadeia = &tree->page_versions[b];
+        while (*cadeia != NULL) {
+            PageVersion *proxima_cadeia = (*cadeia)->proximo_rrn;
+            PageVersion **pv = cadeia;
+            while (*pv != NULL) {
+                PageVersion *v = *pv;
+                if (!cow_version_needed(tree, v->epoch, v->next != NULL ? v->next->epoch : 0)) {
+                    *pv = v->next;
+                    free(v);
+                } else {
+                    pv = &v->next;
+                }
+            }
+            if (*cadeia != NULL) {
+                (*cadeia)->proximo_rrn = proxima_cadeia;
+                cadeia = &(*cadeia)->proximo_rrn;
+            } else {
+                *cadeia = proxima_cadeia;
+            }
+        }
+        
+        RecordVersion **cadeia_registro = &tree->record_versions[b];
+        while (*cadeia_registro != NULL) {
+            RecordVersion *proxima_cadeia = (*cadeia_registro)->proximo_rrn;
+            RecordVersion **rv = cadeia_registro;
+            while (*rv != NULL) {
+                RecordVersion *v = *rv;
+                if (!cow_version_needed(tree, v->epoch, v->next != NULL ? v->next->epoch : 0)) {
+                    *rv = v->next;
+                    free(v);
+                } else {
+                    rv = &v->next;
+                }
+            }
+            if (*cadeia_registro != NULL) {
+                (*cadeia_registro)->proximo_rrn = proxima_cadeia;
+                cadeia_registro = &(*cadeia_registro)->proximo_rrn;
+            } else {
+                *cadeia_registro = proxima_cadeia;
+            }
+        }
+    }
+}
+
+// Buffers de mensagens do modo bufferizado: um NodeBuffer por no interno,
+// guardado em arquivo proprio (posicao = RRN) com um cache LRU de P entradas
+int buffer_slot(BTree *tree, int rrn) {
+    BufferCache *cache = tree->buffer_cache;
+    int livre = -1;
+    
+    for (int i = 0; i < P; i++) {
+        if (cache->rrns[i] == rrn) {
+            cache->usos[i] = ++cache->relogio;
+            return i;
+        }
+        if (livre == -1 || cache->usos[i] < cache->usos[livre]) {
+            livre = i;
+        }
+    }
+    
+    if (cache->rrns[livre] != -1 && cache->modificados[livre]) {
+        fseek(tree->buffer_file, (long)cache->rrns[livre] * sizeof(NodeBuffer), SEEK_SET);
+        fwrite(&cache->buffers[livre], sizeof(NodeBuffer), 1, tree->buffer_file);
+        tree->escritas_buffer++;
+    }
+    
+    fseek(tree->buffer_file, (long)rrn * sizeof(NodeBuffer), SEEK_SET);
+    if (fread(&cache->buffers[livre], sizeof(NodeBuffer), 1, tree->buffer_file) != 1) {
+        cache->buffers[livre].quantidade = 0;
+    }
+    tree->leituras_buffer++;
+    
+    cache->rrns[livre] = rrn;
+    cache->modificados[livre] = false;
+    cache->usos[livre] = ++cache->relogio;
+    return livre;
+}
+
+void buffer_read(BTree *tree, int rrn, NodeBuffer *buffer) {
+    *buffer = tree->buffer_cache->buffers[buffer_slot(tree, rrn)];
+}
+
+// Marca quais nos tem buffer nao vazio, para drenar e capturar sem percorrer a arvore
+void buffer_marcar(BTree *tree, int rrn, int quantidade) {
+    if (rrn >= tree->buffer_pendente_capacidade) {
+        int capacidade = tree->buffer_pendente_capacidade > 0 ? tree->buffer_pendente_capacidade : 1024;
+        while (capacidade <= rrn) capacidade *= 2;
+        tree->buffer_pendente = (bool*)realloc(tree->buffer_pendente, capacidade * sizeof(bool));
+        memset(tree->buffer_pendente + tree->buffer_pendente_capacidade, 0,
+               (capacidade - tree->buffer_pendente_capacidade) * sizeof(bool));
+        tree->buffer_pendente_capacidade = capacidade;
+    }
+    tree->buffer_pendente[rrn] = quantidade > 0;
+}
+
+void buffer_write(BTree *tree, int rrn, NodeBuffer *buffer) {
+    int slot = buffer_slot(tree, rrn);
+    tree->mensagens_pendentes += buffer->quantidade - tree->buffer_cache->buffers[slot].quantidade;
+    buffer_marcar(tree, rrn, buffer->quantidade);
+    tree->buffer_cache->buffers[slot] = *buffer;
+    tree->buffer_cache->modificados[slot] = true;
+}
+
+void buffer_sync(BTree *tree) {
+    BufferCache *cache = tree->buffer_cache;
+    for (int i = 0; i < P; i++) {
+        if (cache->rrns[i] != -1 && cache->modificados[i]) {
+            fseek(tree->buffer_file, (long)cache->rrns[i] * sizeof(NodeBuffer), SEEK_SET);
+            fwrite(&cache->buffers[i], sizeof(NodeBuffer), 1, tree->buffer_file);
+            cache->modificados[i] = false;
+            tree->escritas_buffer++;
+        }
+    }
+    fflush(tree->buffer_file);
+}
+
+int node_find_key(BTreeNode *node, const char *placa) {
+    for (int i = 0; i < node->num_keys; i++) {
+        if (strncmp(placa, node->keys[i], TAMANHO_PLACA) == 0) return i;
+    }
+    return -1;
+}
+
+// Mensagem para uma chave que esta no proprio no interno: aplicada no lugar
+// (insercao atualiza o RRN, remocao deixa a chave como separador com RRN -1)
+void node_apply_message(BTree *tree, BTreeNode *node, int node_rrn, int indice, const Mensagem *mensagem) {
+    cow_preserve_page(tree, node, node_rrn);
+    node->rrns[indice] = mensagem->tipo == MSG_INSERIR ? mensagem->rrn : -1;
+    node->modified = true;
+}
+
+// Apos um split: as mensagens do no dividido seguem suas chaves, e as do pai
+// destinadas a chave promovida passam a valer direto nela
+void buffer_split(BTree *tree, BTreeNode *parent, int parent_rrn, int key_index, int left_rrn, int right_rrn, bool leaf) {
+    const char *mediana = parent->keys[key_index];
+    
+    if (!leaf) {
+        NodeBuffer esquerda, direita;
+        buffer_read(tree, left_rrn, &esquerda);
+        direita.quantidade = 0;
+        
+        int mantidas = 0;
+        for (int i = 0; i < esquerda.quantidade; i++) {
+            Mensagem *m = &esquerda.mensagens[i];
+            int cmp = strncmp(m->placa, mediana, TAMANHO_PLACA);
+            if (cmp < 0) {
+                esquerda.mensagens[mantidas++] = *m;
+            } else if (cmp > 0) {
+                direita.mensagens[direita.quantidade++] = *m;
+            } else {
+                node_apply_message(tree, parent, parent_rrn, key_index, m);
+            }
+        }
+        esquerda.quantidade = mantidas;
+        buffer_write(tree, left_rrn, &esquerda);
+        buffer_write(tree, right_rrn, &direita);
+    }
+    
+    NodeBuffer pai;
+    buffer_read(tree, parent_rrn, &pai);
+    int mantidas = 0;
+    for (int i = 0; i < pai.quantidade; i++) {
+        if (strncmp(pai.mensagens[i].placa, mediana, TAMANHO_PLACA) == 0) {
+            node_apply_message(tree, parent, parent_rrn, key_index, &pai.mensagens[i]);
+        } else {
+            pai.mensagens[mantidas++] = pai.mensagens[i];
+        }
+    }
+    if (mantidas != pai.quantidade) {
+        pai.quantidade = mantidas;
+        buffer_write(tree, parent_rrn, &pai);
+    }
+}
+
 // Arvore B
 void btree_write_node(BTree *tree, BTreeNode *node, int rrn) {
     long offset = sizeof(int) * 2 + rrn * sizeof(BTreeNode);
@@ -190,6 +707,7 @@ void btree_write_node(BTree *tree, BTreeNode *node, int rrn) {
     fwrite(node, sizeof(BTreeNode), 1, tree->index_file);
     fflush(tree->index_file);
     node->modified = false;
+    tree->escritas_pagina++;
 }
 
 void queue_remove_lru(PageQueue *queue, BTree *tree) {
@@ -230,6 +748,7 @@ BTreeNode* btree_read_node(BTree *tree, int rrn) {
     fseek(tree->index_file, offset, SEEK_SET);
     fread(node, sizeof(BTreeNode), 1, tree->index_file);
     node->modified = false;
+    tree->leituras_pagina++;
     
     queue_add(tree->page_queue, node, rrn);
     return node;
@@ -242,24 +761,28 @@ int btree_allocate_node(BTree *tree) {
 void btree_split_child(BTree *tree, BTreeNode *parent, int parent_rrn, int child_index) {
     BTreeNode *full_child = btree_read_node(tree, parent->children[child_index]);
     
+    cow_preserve_page(tree, parent, parent_rrn);
+    cow_preserve_page(tree, full_child, parent->children[child_index]);
+    
     BTreeNode *new_child = (BTreeNode*)calloc(1, sizeof(BTreeNode));
     new_child->is_leaf = full_child->is_leaf;
-    new_child->num_keys = MIN_KEYS;
     
     int mid = MIN_KEYS;
+    int num_direita = MAX_KEYS - mid - 1;
+    new_child->num_keys = num_direita;
     
-    for (int i = 0; i < MIN_KEYS; i++) {
+    for (int i = 0; i < num_direita; i++) {
         strncpy(new_child->keys[i], full_child->keys[mid + 1 + i], TAMANHO_PLACA);
         new_child->rrns[i] = full_child->rrns[mid + 1 + i];
     }
     
     if (!full_child->is_leaf) {
-        for (int i = 0; i <= MIN_KEYS; i++) {
+        for (int i = 0; i <= num_direita; i++) {
             new_child->children[i] = full_child->children[mid + 1 + i];
         }
     }
     
-    full_child->num_keys = MIN_KEYS;
+    full_child->num_keys = mid;
     
     for (int i = parent->num_keys; i > child_index; i--) {
         parent->children[i + 1] = parent->children[i];
@@ -281,6 +804,11 @@ void btree_split_child(BTree *tree, BTreeNode *parent, int parent_rrn, int child
     full_child->modified = true;
     new_child->modified = true;
     
+    if (tree->bufferizado) {
+        buffer_split(tree, parent, parent_rrn, child_index, parent->children[child_index],
+                     new_child_rrn, full_child->is_leaf);
+    }
+    
     btree_write_node(tree, full_child, parent->children[child_index]);
     
     if (queue_is_full(tree->page_queue)) {
@@ -293,6 +821,16 @@ void btree_insert_internal(BTree *tree, BTreeNode *node, int node_rrn, const cha
     int i = node->num_keys - 1;
     
     if (node->is_leaf) {
+        cow_preserve_page(tree, node, node_rrn);
+        
+        // Placa ja na folha: troca o RRN, como o motor bufferizado faz
+        int existente = node_find_key(node, placa);
+        if (existente >= 0) {
+            node->rrns[existente] = data_rrn;
+            node->modified = true;
+            return;
+        }
+        
         while (i >= 0 && strcmp(placa, node->keys[i]) < 0) {
             strncpy(node->keys[i + 1], node->keys[i], TAMANHO_PLACA);
             node->rrns[i + 1] = node->rrns[i];
@@ -307,6 +845,14 @@ void btree_insert_internal(BTree *tree, BTreeNode *node, int node_rrn, const cha
         while (i >= 0 && strcmp(placa, node->keys[i]) < 0) {
             i--;
         }
+        
+        // Separador deixado por uma remocao bufferizada: reaproveita a chave
+        if (i >= 0 && strcmp(placa, node->keys[i]) == 0) {
+            cow_preserve_page(tree, node, node_rrn);
+            node->rrns[i] = data_rrn;
+            node->modified = true;
+            return;
+        }
         i++;
         
         BTreeNode *child = btree_read_node(tree, node->children[i]);
@@ -314,6 +860,11 @@ void btree_insert_internal(BTree *tree, BTreeNode *node, int node_rrn, const cha
         if (child->num_keys == MAX_KEYS) {
             btree_split_child(tree, node, node_rrn, i);
             
+            // O separador promovido pode ser o proprio separador removido
+            if (strcmp(placa, node->keys[i]) == 0) {
+                node->rrns[i] = data_rrn;
+                return;
+            }
             if (strcmp(placa, node->keys[i]) > 0) {
                 i++;
             }
@@ -324,7 +875,24 @@ void btree_insert_internal(BTree *tree, BTreeNode *node, int node_rrn, const cha
     }
 }
 
-void btree_insert(BTree *tree, const char *placa, int data_rrn) {
+BTreeNode* btree_split_root(BTree *tree) {
+    BTreeNode *new_root = (BTreeNode*)calloc(1, sizeof(BTreeNode));
+    new_root->is_leaf = false;
+    new_root->children[0] = tree->root_rrn;
+    
+    int new_root_rrn = btree_allocate_node(tree);
+    tree->root_rrn = new_root_rrn;
+    
+    btree_split_child(tree, new_root, new_root_rrn, 0);
+    
+    if (queue_is_full(tree->page_queue)) {
+        queue_remove_lru(tree->page_queue, tree);
+    }
+    queue_add(tree->page_queue, new_root, new_root_rrn);
+    return new_root;
+}
+
+void btree_insert_direct(BTree *tree, const char *placa, int data_rrn) {
     if (tree->root_rrn == -1) {
         BTreeNode *root = (BTreeNode*)calloc(1, sizeof(BTreeNode));
         strncpy(root->keys[0], placa, TAMANHO_PLACA);
@@ -347,405 +915,3563 @@ void btree_insert(BTree *tree, const char *placa, int data_rrn) {
     BTreeNode *root = btree_read_node(tree, tree->root_rrn);
     
     if (root->num_keys == MAX_KEYS) {
-        BTreeNode *new_root = (BTreeNode*)calloc(1, sizeof(BTreeNode));
-        new_root->is_leaf = false;
-        new_root->children[0] = tree->root_rrn;
-        
-        int new_root_rrn = btree_allocate_node(tree);
-        tree->root_rrn = new_root_rrn;
-        
-        btree_split_child(tree, new_root, new_root_rrn, 0);
-        
-        if (queue_is_full(tree->page_queue)) {
-            queue_remove_lru(tree->page_queue, tree);
-        }
-        queue_add(tree->page_queue, new_root, new_root_rrn);
-        
-        btree_insert_internal(tree, new_root, new_root_rrn, placa, data_rrn);
+        BTreeNode *new_root = btree_split_root(tree);
+        btree_insert_internal(tree, new_root, tree->root_rrn, placa, data_rrn);
     } else {
         btree_insert_internal(tree, root, tree->root_rrn, placa, data_rrn);
     }
 }
 
-int btree_search_internal(BTree *tree, int node_rrn, const char *placa) {
-    if (node_rrn == -1) return -1;
+// Modo de insercao bufferizado (estilo arvore B-epsilon)
+// Insercoes e remocoes viram mensagens no buffer da raiz e descem em lotes
+// quando o buffer enche. O fluxo so empurra mensagens para nos nao cheios,
+// como a insercao top-down, entao sempre ha progresso.
+
+// Aplica a mensagem na folha; false se for insercao em folha cheia
+bool leaf_apply_message(BTree *tree, BTreeNode *leaf, int leaf_rrn, const Mensagem *mensagem) {
+    int indice = node_find_key(leaf, mensagem->placa);
     
-    BTreeNode *node = btree_read_node(tree, node_rrn);
+    if (indice >= 0) {
+        cow_preserve_page(tree, leaf, leaf_rrn);
+        if (mensagem->tipo == MSG_INSERIR) {
+            leaf->rrns[indice] = mensagem->rrn;
+        } else {
+            for (int j = indice; j < leaf->num_keys - 1; j++) {
+                strncpy(leaf->keys[j], leaf->keys[j + 1], TAMANHO_PLACA);
+                leaf->rrns[j] = leaf->rrns[j + 1];
+            }
+            leaf->num_keys--;
+        }
+        leaf->modified = true;
+        return true;
+    }
     
+    if (mensagem->tipo == MSG_REMOVER) return true;
+    if (leaf->num_keys == MAX_KEYS) return false;
+    
+    btree_insert_internal(tree, leaf, leaf_rrn, mensagem->placa, mensagem->rrn);
+    return true;
+}
+
+int node_child_index(BTreeNode *node, const char *placa) {
     int i = 0;
     while (i < node->num_keys && strcmp(placa, node->keys[i]) > 0) {
         i++;
     }
-    
-    if (i < node->num_keys && strcmp(placa, node->keys[i]) == 0) {
-        return node->rrns[i];
-    }
-    
-    if (node->is_leaf) {
-        return -1;
-    }
-    
-    return btree_search_internal(tree, node->children[i], placa);
+    return i;
 }
 
-bool data_read_veiculo(BTree *tree, int rrn, Veiculo *veiculo) {
-    long offset = rrn * sizeof(Veiculo);
-    fseek(tree->data_file, offset, SEEK_SET);
-    size_t read = fread(veiculo, sizeof(Veiculo), 1, tree->data_file);
-    return read == 1;
+int comparar_mensagens(const void *a, const void *b) {
+    const Mensagem *ma = (const Mensagem*)a;
+    const Mensagem *mb = (const Mensagem*)b;
+    int cmp = strncmp(ma->placa, mb->placa, TAMANHO_PLACA);
+    if (cmp != 0) return cmp;
+    return (ma->sequencia > mb->sequencia) - (ma->sequencia < mb->sequencia);
 }
 
-void data_print_veiculo(Veiculo *veiculo) {
-    printf("\n--- Dados do Veiculo ---\n");
-    printf("Placa: %s\n", veiculo->placa);
-    printf("Modelo: %s\n", veiculo->modelo);
-    printf("Marca: %s\n", veiculo->marca);
-    printf("Ano: %d\n", veiculo->ano);
-    printf("Categoria: %s\n", veiculo->categoria);
-    printf("Quilometragem: %d km\n", veiculo->quilometragem);
-    printf("Status: %s\n", veiculo->status);
-    printf("------------------------\n\n");
+int comparar_sequencia(const void *a, const void *b) {
+    const Mensagem *ma = (const Mensagem*)a;
+    const Mensagem *mb = (const Mensagem*)b;
+    return (ma->sequencia > mb->sequencia) - (ma->sequencia < mb->sequencia);
 }
 
-void btree_search(BTree *tree, const char *placa) {
-    if (tree->root_rrn == -1) {
-        printf("Arvore vazia!\n");
-        return;
-    }
-    
-    char placa_busca[100];
-    strncpy(placa_busca, placa, sizeof(placa_busca) - 1);
-    placa_busca[sizeof(placa_busca) - 1] = '\0';
-    normalizar_placa(placa_busca);
-    
-    printf("\nBuscando placa: '%s'\n", placa_busca);
-    
-    int data_rrn = btree_search_internal(tree, tree->root_rrn, placa_busca);
-    
-    if (data_rrn == -1) {
-        printf("Placa '%s' nao encontrada!\n", placa_busca);
-        return;
-    }
-    
-    printf("\nVeiculo encontrado!\n");
-    Veiculo veiculo;
-    if (data_read_veiculo(tree, data_rrn, &veiculo)) {
-        data_print_veiculo(&veiculo);
-    }
+void mensagem_preencher(BTree *tree, Mensagem *mensagem, const char *placa, int rrn, int tipo) {
+    memset(mensagem, 0, sizeof(Mensagem));
+    strncpy(mensagem->placa, placa, TAMANHO_PLACA - 1);
+    mensagem->rrn = rrn;
+    mensagem->tipo = tipo;
+    mensagem->sequencia = tree->proxima_sequencia++;
 }
 
-void data_mark_removed(BTree *tree, int rrn) {
-    Veiculo veiculo;
-    if (data_read_veiculo(tree, rrn, &veiculo)) {
-        strcpy(veiculo.status, "*REMOVIDO*");
-        long offset = rrn * sizeof(Veiculo);
-        fseek(tree->data_file, offset, SEEK_SET);
-        fwrite(&veiculo, sizeof(Veiculo), 1, tree->data_file);
-        fflush(tree->data_file);
+bool buffer_append(BTree *tree, BTreeNode *node, int node_rrn, const Mensagem *mensagem) {
+    int indice = node_find_key(node, mensagem->placa);
+    if (indice >= 0) {
+        node_apply_message(tree, node, node_rrn, indice, mensagem);
+        return true;
     }
+    
+    NodeBuffer buffer;
+    buffer_read(tree, node_rrn, &buffer);
+    if (buffer.quantidade == BUFFER_MENSAGENS) return false;
+    
+    buffer.mensagens[buffer.quantidade++] = *mensagem;
+    buffer_write(tree, node_rrn, &buffer);
+    return true;
 }
 
-void text_append_veiculo(BTree *tree, Veiculo *veiculo, int rrn) {
-    fprintf(tree->text_file, "----------------------------------------\n");
-    fprintf(tree->text_file, "RNN: %d\n", rrn);
-    fprintf(tree->text_file, "Placa: %s\n", veiculo->placa);
-    fprintf(tree->text_file, "Modelo: %s\n", veiculo->modelo);
-    fprintf(tree->text_file, "Marca: %s\n", veiculo->marca);
-    fprintf(tree->text_file, "Ano: %d\n", veiculo->ano);
-    fprintf(tree->text_file, "Categoria: %s\n", veiculo->categoria);
-    fprintf(tree->text_file, "Quilometragem: %d km\n", veiculo->quilometragem);
-    fprintf(tree->text_file, "Status: %s\n", veiculo->status);
-    fprintf(tree->text_file, "----------------------------------------\n\n");
-    fflush(tree->text_file);
-}
-
-void text_rebuild_file(BTree *tree) {
-    fclose(tree->text_file);
-    tree->text_file = fopen(tree->text_filename, "w");
+// Desce as mensagens do no (interno e nao cheio) para os filhos. As que nao
+// couberem ficam no buffer para o proximo lote.
+void buffer_flush(BTree *tree, int node_rrn) {
+    NodeBuffer lote;
+    buffer_read(tree, node_rrn, &lote);
     
-    fprintf(tree->text_file, "========================================\n");
-    fprintf(tree->text_file, "   SISTEMA DE LOCACAO DE VEICULOS\n");
-    fprintf(tree->text_file, "========================================\n\n");
+    NodeBuffer restantes;
+    restantes.quantidade = 0;
+    buffer_write(tree, node_rrn, &restantes);
     
-    fseek(tree->data_file, 0, SEEK_END);
-    long file_size = ftell(tree->data_file);
-    int num_records = file_size / sizeof(Veiculo);
+    // Ordem por placa agrupa as mensagens por filho; a sequencia mantem a
+    // ordem de chegada entre mensagens da mesma placa
+    qsort(lote.mensagens, lote.quantidade, sizeof(Mensagem), comparar_mensagens);
     
-    for (int i = 0; i < num_records; i++) {
-        Veiculo veiculo;
-        if (data_read_veiculo(tree, i, &veiculo)) {
-            if (strcmp(veiculo.status, "*REMOVIDO*") != 0) {
-                text_append_veiculo(tree, &veiculo, i);
+    bool parar = false;
+    for (int i = 0; i < lote.quantidade; i++) {
+        Mensagem *m = &lote.mensagens[i];
+        
+        // Um split de filho pode ter promovido a placa para este no: a
+        // mensagem vale direto na chave e nunca volta ao buffer do no dela
+        BTreeNode *node = btree_read_node(tree, node_rrn);
+        int indice = node_find_key(node, m->placa);
+        if (indice >= 0) {
+            node_apply_message(tree, node, node_rrn, indice, m);
+            continue;
+        }
+        
+        if (parar) {
+            restantes.mensagens[restantes.quantidade++] = *m;
+            continue;
+        }
+        
+        int c = node_child_index(node, m->placa);
+        int child_rrn = node->children[c];
+        BTreeNode *child = btree_read_node(tree, child_rrn);
+        
+        bool precisa_split = child->is_leaf
+            ? child->num_keys == MAX_KEYS && m->tipo == MSG_INSERIR && node_find_key(child, m->placa) < 0
+            : child->num_keys == MAX_KEYS;
+        
+        if (precisa_split) {
+            node = btree_read_node(tree, node_rrn);
+            if (node->num_keys == MAX_KEYS) {
+                parar = true;
+                restantes.mensagens[restantes.quantidade++] = *m;
+                continue;
             }
+            btree_read_node(tree, child_rrn);
+            btree_split_child(tree, node, node_rrn, c);
+            i--;
+            continue;
+        }
+        
+        if (child->is_leaf) {
+            leaf_apply_message(tree, child, child_rrn, m);
+            continue;
+        }
+        
+        if (buffer_append(tree, child, child_rrn, m)) continue;
+        
+        buffer_flush(tree, child_rrn);
+        child = btree_read_node(tree, child_rrn);
+        if (!buffer_append(tree, child, child_rrn, m)) {
+            parar = true;
+            restantes.mensagens[restantes.quantidade++] = *m;
         }
     }
     
-    fflush(tree->text_file);
+    // Reaplica os restantes na ordem original de chegada
+    if (restantes.quantidade > 0) {
+        NodeBuffer atual;
+        buffer_read(tree, node_rrn, &atual);
+        for (int i = 0; i < atual.quantidade; i++) {
+            restantes.mensagens[restantes.quantidade++] = atual.mensagens[i];
+        }
+        buffer_write(tree, node_rrn, &restantes);
+    }
 }
 
-bool btree_remove(BTree *tree, const char *placa) {
+void btree_buffered_message(BTree *tree, Mensagem *mensagem) {
     if (tree->root_rrn == -1) {
-        printf("Arvore vazia!\n");
-        return false;
-    }
-    
-    int data_rrn = btree_search_internal(tree, tree->root_rrn, placa);
-    
-    if (data_rrn == -1) {
-        printf("Placa '%s' nao encontrada!\n", placa);
-        return false;
+        if (mensagem->tipo == MSG_INSERIR) {
+            btree_insert_direct(tree, mensagem->placa, mensagem->rrn);
+        }
+        return;
     }
     
-    data_mark_removed(tree, data_rrn);
-    
     BTreeNode *root = btree_read_node(tree, tree->root_rrn);
     
-    for (int i = 0; i < root->num_keys; i++) {
-        if (strcmp(placa, root->keys[i]) == 0) {
-            for (int j = i; j < root->num_keys - 1; j++) {
-                strncpy(root->keys[j], root->keys[j + 1], TAMANHO_PLACA);
-                root->rrns[j] = root->rrns[j + 1];
-            }
-            root->num_keys--;
-            root->modified = true;
-            
-            printf("Veiculo removido com sucesso!\n");
-            text_rebuild_file(tree);
-            return true;
+    if (root->is_leaf) {
+        if (!leaf_apply_message(tree, root, tree->root_rrn, mensagem)) {
+            btree_insert_direct(tree, mensagem->placa, mensagem->rrn);
         }
+        return;
     }
     
-    return false;
+    // Cada flush de uma raiz nao cheia desce ao menos uma mensagem, entao o
+    // laco termina
+    while (!buffer_append(tree, root, tree->root_rrn, mensagem)) {
+        if (root->num_keys == MAX_KEYS) {
+            btree_split_root(tree);
+        }
+        buffer_flush(tree, tree->root_rrn);
+        root = btree_read_node(tree, tree->root_rrn);
+    }
 }
 
-void btree_print_node(BTree *tree, int rrn, int level) {
-    if (rrn == -1) return;
+// Copia as mensagens de todos os buffers nao vazios (esvaziando-os se pedido).
+// So os buffers marcados sao lidos; nenhuma pagina da arvore e tocada.
+int buffer_collect(BTree *tree, Mensagem **mensagens, bool esvaziar) {
+    *mensagens = (Mensagem*)malloc((tree->mensagens_pendentes + 1) * sizeof(Mensagem));
+    int quantidade = 0;
     
-    BTreeNode *node = btree_read_node(tree, rrn);
-    
-    for (int i = 0; i < level; i++) printf("  ");
+    for (int rrn = 0; rrn < tree->buffer_pendente_capacidade; rrn++) {
+        if (!tree->buffer_pendente[rrn]) continue;
+        
+        NodeBuffer buffer;
+        buffer_read(tree, rrn, &buffer);
+        memcpy(*mensagens + quantidade, buffer.mensagens, buffer.quantidade * sizeof(Mensagem));
+        quantidade += buffer.quantidade;
+        if (esvaziar) {
+            buffer.quantidade = 0;
+            buffer_write(tree, rrn, &buffer);
+        }
+    }
+    return quantidade;
+}
+
+// Aplica uma mensagem direto na arvore, sem passar por buffers
+void btree_apply_direct(BTree *tree, const Mensagem *mensagem) {
+    int rrn = tree->root_rrn;
+    while (rrn != -1) {
+        BTreeNode *node = btree_read_node(tree, rrn);
+        int indice = node_find_key(node, mensagem->placa);
+        
+        if (indice >= 0 || node->is_leaf) {
+            if (node->is_leaf) {
+                if (leaf_apply_message(tree, node, rrn, mensagem)) return;
+                break;
+            }
+            node_apply_message(tree, node, rrn, indice, mensagem);
+            return;
+        }
+        rrn = node->children[node_child_index(node, mensagem->placa)];
+    }
+    
+    if (mensagem->tipo == MSG_INSERIR) {
+        btree_insert_direct(tree, mensagem->placa, mensagem->rrn);
+    }
+}
+
+// Esvazia todos os buffers aplicando as mensagens em ordem de chegada
+void btree_buffer_drain(BTree *tree) {
+    if (!tree->bufferizado || tree->mensagens_pendentes == 0) return;
+    
+    Mensagem *mensagens;
+    int quantidade = buffer_collect(tree, &mensagens, true);
+    qsort(mensagens, quantidade, sizeof(Mensagem), comparar_sequencia);
+    
+    tree->bufferizado = false;
+    for (int i = 0; i < quantidade; i++) {
+        btree_apply_direct(tree, &mensagens[i]);
+    }
+    tree->bufferizado = true;
+    free(mensagens);
+}
+
+// Reconstroi as marcas, o total pendente e a proxima sequencia a partir
+// de um arquivo de buffers existente
+void buffer_scan_file(BTree *tree) {
+    NodeBuffer buffer;
+    fseek(tree->buffer_file, 0, SEEK_SET);
+    for (int rrn = 0; fread(&buffer, sizeof(NodeBuffer), 1, tree->buffer_file) == 1; rrn++) {
+        if (buffer.quantidade <= 0) continue;
+        buffer_marcar(tree, rrn, buffer.quantidade);
+        tree->mensagens_pendentes += buffer.quantidade;
+        for (int i = 0; i < buffer.quantidade; i++) {
+            if (buffer.mensagens[i].sequencia >= tree->proxima_sequencia) {
+                tree->proxima_sequencia = buffer.mensagens[i].sequencia + 1;
+            }
+        }
+    }
+}
+
+bool btree_set_buffered(BTree *tree, bool ativar) {
+    if (ativar == tree->bufferizado) return true;
+    
+    if (ativar) {
+        tree->buffer_file = fopen(tree->buffer_filename, "rb+");
+        if (!tree->buffer_file) tree->buffer_file = fopen(tree->buffer_filename, "wb+");
+        if (!tree->buffer_file) return false;
+        
+        tree->buffer_cache = (BufferCache*)calloc(1, sizeof(BufferCache));
+        for (int i = 0; i < P; i++) tree->buffer_cache->rrns[i] = -1;
+        buffer_scan_file(tree);
+        tree->bufferizado = true;
+        return true;
+    }
+    
+    btree_buffer_drain(tree);
+    fclose(tree->buffer_file);
+    free(tree->buffer_cache);
+    free(tree->buffer_pendente);
+    tree->buffer_file = NULL;
+    tree->buffer_cache = NULL;
+    tree->buffer_pendente = NULL;
+    tree->buffer_pendente_capacidade = 0;
+    tree->bufferizado = false;
+    remove(tree->buffer_filename);
+    return true;
+}
+
+void btree_insert(BTree *tree, const char *placa, int data_rrn) {
+    if (!tree->bufferizado) {
+        btree_insert_direct(tree, placa, data_rrn);
+        return;
+    }
+    
+    Mensagem mensagem;
+    mensagem_preencher(tree, &mensagem, placa, data_rrn, MSG_INSERIR);
+    btree_buffered_message(tree, &mensagem);
+}
+
+int btree_search_internal(BTree *tree, int node_rrn, const char *placa) {
+    if (node_rrn == -1) return -1;
+    
+    BTreeNode *node = btree_read_node(tree, node_rrn);
+    
+    int i = 0;
+    while (i < node->num_keys && strcmp(placa, node->keys[i]) > 0) {
+        i++;
+    }
+    
+    if (i < node->num_keys && strcmp(placa, node->keys[i]) == 0) {
+        return node->rrns[i];
+    }
+    
+    if (node->is_leaf) {
+        return -1;
+    }
+    
+    // Mensagens do buffer sao mais novas que tudo abaixo do no
+    if (tree->bufferizado && tree->buffer_pendente_capacidade > node_rrn &&
+        tree->buffer_pendente[node_rrn]) {
+        NodeBuffer buffer;
+        buffer_read(tree, node_rrn, &buffer);
+        Mensagem *mais_nova = NULL;
+        for (int j = 0; j < buffer.quantidade; j++) {
+            if (strncmp(placa, buffer.mensagens[j].placa, TAMANHO_PLACA) == 0 &&
+                (mais_nova == NULL || buffer.mensagens[j].sequencia > mais_nova->sequencia)) {
+                mais_nova = &buffer.mensagens[j];
+            }
+        }
+        if (mais_nova != NULL) {
+            return mais_nova->tipo == MSG_INSERIR ? mais_nova->rrn : -1;
+        }
+    }
+    
+    return btree_search_internal(tree, node->children[i], placa);
+}
+
+// Formato compacto
+#define COMPACTO_FIXO_CABECALHO (4 + 5 * (int)sizeof(int))
+
+// Le 'num' strings terminadas em '\0' para entradas de 'tamanho' bytes;
+// NULL se o cabecalho acabar antes
+char* compact_ler_strings(char *p, char *fim, char *entradas, int tamanho, int num) {
+    for (int i = 0; i < num; i++) {
+        if (p >= fim) return NULL;
+        int n = strnlen(p, fim - p);
+        if (p + n >= fim) return NULL;
+        memset(entradas + i * tamanho, 0, tamanho);
+        memcpy(entradas + i * tamanho, p, n < tamanho - 1 ? n : tamanho - 1);
+        p += n + 1;
+    }
+    return p;
+}
+
+char* compact_gravar_strings(char *p, const char *entradas, int tamanho, int num) {
+    for (int i = 0; i < num; i++) {
+        int n = strnlen(entradas + i * tamanho, tamanho - 1);
+        memcpy(p, entradas + i * tamanho, n);
+        p[n] = '\0';
+        p += n + 1;
+    }
+    return p;
+}
+
+CompactHeader* compact_read_header(FILE *arquivo) {
+    char magico[4];
+    int campos[5];
+    fseek(arquivo, 0, SEEK_SET);
+    if (fread(magico, sizeof(magico), 1, arquivo) != 1 ||
+        memcmp(magico, COMPACTO_MAGICO, sizeof(magico)) != 0 ||
+        fread(campos, sizeof(int), 5, arquivo) != 5) {
+        return NULL;
+    }
+    
+    CompactHeader *d = (CompactHeader*)calloc(1, sizeof(CompactHeader));
+    memcpy(d->magico, magico, sizeof(magico));
+    d->num_modelos = campos[0];
+    d->num_marcas = campos[1];
+    d->num_categorias = campos[2];
+    d->num_status = campos[3];
+    d->base = campos[4];
+    if (d->num_modelos < 0 || d->num_modelos > DICT_MODELO_MAX ||
+        d->num_marcas < 0 || d->num_marcas > DICT_MARCA_MAX ||
+        d->num_categorias < 0 || d->num_categorias > DICT_CATEGORIA_MAX ||
+        d->num_status < 0 || d->num_status > DICT_STATUS_MAX ||
+        d->base < COMPACTO_FIXO_CABECALHO) {
+        free(d);
+        return NULL;
+    }
+    
+    // Strings do dicionario, de logo apos os campos fixos ate a base
+    int tamanho = d->base - COMPACTO_FIXO_CABECALHO;
+    char *texto = (char*)malloc(tamanho > 0 ? tamanho : 1);
+    char *fim = texto + fread(texto, 1, tamanho, arquivo);
+    char *p = compact_ler_strings(texto, fim, &d->modelos[0][0], TAMANHO_MODELO, d->num_modelos);
+    if (p) p = compact_ler_strings(p, fim, &d->marcas[0][0], TAMANHO_MARCA, d->num_marcas);
+    if (p) p = compact_ler_strings(p, fim, &d->categorias[0][0], TAMANHO_CATEGORIA, d->num_categorias);
+    if (p) p = compact_ler_strings(p, fim, &d->status[0][0], TAMANHO_STATUS, d->num_status);
+    free(texto);
+    if (!p) {
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+// O dicionario passou da folga: os registros andam para frente (do fim para
+// o inicio, ja que as faixas se sobrepoem) e a base muda
+void compact_realocar(FILE *arquivo, CompactHeader *d, int nova_base) {
+    fseek(arquivo, 0, SEEK_END);
+    long fim = ftell(arquivo);
+    long restante = d->base > 0 && fim > d->base ? fim - d->base : 0;
+    
+    size_t tamanho_bloco = BLOCO_PARTICAO * sizeof(CompactVeiculo);
+    char *bloco = (char*)malloc(tamanho_bloco);
+    while (restante > 0) {
+        long n = restante < (long)tamanho_bloco ? restante : (long)tamanho_bloco;
+        restante -= n;
+        fseek(arquivo, d->base + restante, SEEK_SET);
+        fread(bloco, 1, n, arquivo);
+        fseek(arquivo, nova_base + restante, SEEK_SET);
+        fwrite(bloco, 1, n, arquivo);
+    }
+    free(bloco);
+    d->base = nova_base;
+}
+
+void compact_write_header(FILE *arquivo, CompactHeader *d) {
+    char *cabecalho = (char*)malloc(sizeof(CompactHeader));
+    char *p = cabecalho + COMPACTO_FIXO_CABECALHO;
+    p = compact_gravar_strings(p, &d->modelos[0][0], TAMANHO_MODELO, d->num_modelos);
+    p = compact_gravar_strings(p, &d->marcas[0][0], TAMANHO_MARCA, d->num_marcas);
+    p = compact_gravar_strings(p, &d->categorias[0][0], TAMANHO_CATEGORIA, d->num_categorias);
+    p = compact_gravar_strings(p, &d->status[0][0], TAMANHO_STATUS, d->num_status);
+    int tamanho = p - cabecalho;
+    
+    if (tamanho > d->base) {
+        compact_realocar(arquivo, d, tamanho + COMPACTO_FOLGA);
+    }
+    
+    int campos[5] = { d->num_modelos, d->num_marcas, d->num_categorias, d->num_status, d->base };
+    memcpy(cabecalho, COMPACTO_MAGICO, 4);
+    memcpy(cabecalho + 4, campos, sizeof(campos));
+    
+    fseek(arquivo, 0, SEEK_SET);
+    fwrite(cabecalho, 1, tamanho, arquivo);
+    fflush(arquivo);
+    free(cabecalho);
+}
+
+// Retorna o codigo do valor, incluindo-o no dicionario se for novo; -1 se cheio
+int compact_codigo(char *entradas, int tamanho, int *num, int max, const char *valor) {
+    for (int i = 0; i < *num; i++) {
+        if (strncmp(entradas + i * tamanho, valor, tamanho) == 0) return i;
+    }
+    if (*num >= max) return -1;
+    
+    char *nova = entradas + (*num) * tamanho;
+    memset(nova, 0, tamanho);
+    memcpy(nova, valor, strnlen(valor, tamanho - 1));
+    return (*num)++;
+}
+
+bool compact_encode(CompactHeader *d, const Veiculo *veiculo, CompactVeiculo *compacto, bool *dicionario_alterado) {
+    int antes = d->num_modelos + d->num_marcas + d->num_categorias + d->num_status;
+    
+    int modelo = compact_codigo(&d->modelos[0][0], TAMANHO_MODELO, &d->num_modelos, DICT_MODELO_MAX, veiculo->modelo);
+    int marca = compact_codigo(&d->marcas[0][0], TAMANHO_MARCA, &d->num_marcas, DICT_MARCA_MAX, veiculo->marca);
+    int categoria = compact_codigo(&d->categorias[0][0], TAMANHO_CATEGORIA, &d->num_categorias, DICT_CATEGORIA_MAX, veiculo->categoria);
+    int status = compact_codigo(&d->status[0][0], TAMANHO_STATUS, &d->num_status, DICT_STATUS_MAX, veiculo->status);
+    
+    *dicionario_alterado = d->num_modelos + d->num_marcas + d->num_categorias + d->num_status != antes;
+    if (modelo < 0 || marca < 0 || categoria < 0 || status < 0) {
+        return false;
+    }
+    
+    memset(compacto, 0, sizeof(CompactVeiculo));
+    memcpy(compacto->placa, veiculo->placa, sizeof(compacto->placa));
+    compacto->modelo = modelo;
+    compacto->marca = marca;
+    compacto->categoria = categoria;
+    compacto->status = status;
+    compacto->ano = veiculo->ano;
+    compacto->quilometragem = veiculo->quilometragem;
+    return true;
+}
+
+void compact_decode(CompactHeader *d, const CompactVeiculo *compacto, Veiculo *veiculo) {
+    memset(veiculo, 0, sizeof(Veiculo));
+    memcpy(veiculo->placa, compacto->placa, sizeof(compacto->placa));
+    if (compacto->modelo < d->num_modelos) memcpy(veiculo->modelo, d->modelos[compacto->modelo], TAMANHO_MODELO);
+    if (compacto->marca < d->num_marcas) memcpy(veiculo->marca, d->marcas[compacto->marca], TAMANHO_MARCA);
+    if (compacto->categoria < d->num_categorias) memcpy(veiculo->categoria, d->categorias[compacto->categoria], TAMANHO_CATEGORIA);
+    if (compacto->status < d->num_status) memcpy(veiculo->status, d->status[compacto->status], TAMANHO_STATUS);
+    veiculo->ano = compacto->ano;
+    veiculo->quilometragem = compacto->quilometragem;
+}
+
+long data_offset(CompactHeader *dicionario, int rrn) {
+    if (dicionario != NULL) {
+        return dicionario->base + (long)rrn * sizeof(CompactVeiculo);
+    }
+    return (long)rrn * sizeof(Veiculo);
+}
+
+// Le ate 'quantidade' registros a partir de 'primeiro' com um unico fread,
+// em qualquer um dos dois formatos
+int data_read_block_file(FILE *arquivo, CompactHeader *dicionario, int primeiro, int quantidade, Veiculo *veiculos) {
+    fseek(arquivo, data_offset(dicionario, primeiro), SEEK_SET);
+    
+    if (dicionario == NULL) {
+        return fread(veiculos, sizeof(Veiculo), quantidade, arquivo);
+    }
+    
+    // Os registros compactos cabem na parte final do proprio buffer de saida
+    CompactVeiculo *compactos = (CompactVeiculo*)((char*)(veiculos + quantidade) - quantidade * sizeof(CompactVeiculo));
+    int lidos = fread(compactos, sizeof(CompactVeiculo), quantidade, arquivo);
+    for (int i = 0; i < lidos; i++) {
+        CompactVeiculo compacto = compactos[i];
+        compact_decode(dicionario, &compacto, &veiculos[i]);
+    }
+    return lidos;
+}
+
+int data_num_registros_file(FILE *arquivo, CompactHeader *dicionario) {
+    fseek(arquivo, 0, SEEK_END);
+    long tamanho = ftell(arquivo) - data_offset(dicionario, 0);
+    if (tamanho <= 0) return 0;
+    return tamanho / (dicionario != NULL ? sizeof(CompactVeiculo) : sizeof(Veiculo));
+}
+
+// Pool de disponiveis: por categoria, uma lista duplamente encadeada (FIFO)
+// dos RRNs com status Disponivel. O encadeamento fica nas proprias entradas
+// indexadas por RRN, entao ligar e desligar sao O(1). A retirada ainda
+// confere a placa no indice (O(log n)) e a frota tenta os shards em ordem.
+int pool_categoria(AvailabilityPool *pool, const char *categoria, bool criar) {
+    PoolCabecalho *c = &pool->cabecalho;
+    for (int i = 0; i < c->num_categorias; i++) {
+        if (strncmp(c->categorias[i], categoria, TAMANHO_CATEGORIA) == 0) return i;
+    }
+    if (!criar || c->num_categorias == POOL_MAX_CATEGORIAS) return -1;
+    
+    int nova = c->num_categorias++;
+    strncpy(c->categorias[nova], categoria, TAMANHO_CATEGORIA - 1);
+    c->categorias[nova][TAMANHO_CATEGORIA - 1] = '\0';
+    c->cabecas[nova] = -1;
+    c->caudas[nova] = -1;
+    c->disponiveis[nova] = 0;
+    return nova;
+}
+
+void pool_garantir(AvailabilityPool *pool, int rrn) {
+    if (rrn < pool->capacidade) return;
+    
+    int capacidade = pool->capacidade > 0 ? pool->capacidade : 1024;
+    while (capacidade <= rrn) capacidade *= 2;
+    pool->entradas = (PoolEntrada*)realloc(pool->entradas, capacidade * sizeof(PoolEntrada));
+    for (int i = pool->capacidade; i < capacidade; i++) {
+        pool->entradas[i].proximo = -1;
+        pool->entradas[i].anterior = -1;
+        pool->entradas[i].categoria = -1;
+    }
+    pool->capacidade = capacidade;
+}
+
+void pool_desligar(AvailabilityPool *pool, int rrn) {
+    if (rrn >= pool->capacidade || pool->entradas[rrn].categoria < 0) return;
+    
+    PoolEntrada *e = &pool->entradas[rrn];
+    PoolCabecalho *c = &pool->cabecalho;
+    if (e->anterior != -1) pool->entradas[e->anterior].proximo = e->proximo;
+    else c->cabecas[e->categoria] = e->proximo;
+    if (e->proximo != -1) pool->entradas[e->proximo].anterior = e->anterior;
+    else c->caudas[e->categoria] = e->anterior;
+    
+    c->disponiveis[e->categoria]--;
+    e->proximo = -1;
+    e->anterior = -1;
+    e->categoria = -1;
+}
+
+void pool_ligar(AvailabilityPool *pool, int rrn, int categoria) {
+    pool_garantir(pool, rrn);
+    
+    PoolEntrada *e = &pool->entradas[rrn];
+    PoolCabecalho *c = &pool->cabecalho;
+    e->categoria = categoria;
+    e->proximo = -1;
+    e->anterior = c->caudas[categoria];
+    if (e->anterior != -1) pool->entradas[e->anterior].proximo = rrn;
+    else c->cabecas[categoria] = rrn;
+    c->caudas[categoria] = rrn;
+    c->disponiveis[categoria]++;
+}
+
+// Classifica o status gravado. Ignora espacos e CR no fim e aceita a grafia
+// acentuada (UTF-8) usada no veiculos.dat original.
+int status_situacao(const char *status) {
+    char texto[TAMANHO_STATUS + 1];
+    memcpy(texto, status, TAMANHO_STATUS);
+    texto[TAMANHO_STATUS] = '\0';
+    
+    int n = strlen(texto);
+    while (n > 0 && (texto[n - 1] == ' ' || texto[n - 1] == '\t' ||
+                     texto[n - 1] == '\r' || texto[n - 1] == '\n')) {
+        texto[--n] = '\0';
+    }
+    
+    if (strcmp(texto, STATUS_DISPONIVEL) == 0 || strcmp(texto, "Dispon\xc3\xadvel") == 0) {
+        return SITUACAO_DISPONIVEL;
+    }
+    if (strcmp(texto, STATUS_ALUGADO) == 0) {
+        return SITUACAO_ALUGADO;
+    }
+    return SITUACAO_OUTRA;
+}
+
+// Chamada a cada escrita de registro: mantem o RRN no pool sse esta disponivel
+void pool_atualizar(AvailabilityPool *pool, int rrn, const Veiculo *veiculo) {
+    if (pool == NULL) return;
+    
+    pool_desligar(pool, rrn);
+    if (status_situacao(veiculo->status) != SITUACAO_DISPONIVEL) return;
+    
+    int categoria = pool_categoria(pool, veiculo->categoria, true);
+    if (categoria >= 0) {
+        pool_ligar(pool, rrn, categoria);
+    }
+}
+
+bool data_read_veiculo(BTree *tree, int rrn, Veiculo *veiculo) {
+    tree->leituras_registro++;
+    return data_read_block_file(tree->data_file, tree->dicionario, rrn, 1, veiculo) == 1;
+}
+
+int data_read_block(BTree *tree, int primeiro, int quantidade, Veiculo *veiculos) {
+    int lidos = data_read_block_file(tree->data_file, tree->dicionario, primeiro, quantidade, veiculos);
+    tree->leituras_registro += lidos;
+    return lidos;
+}
+
+int data_num_registros(BTree *tree) {
+    return data_num_registros_file(tree->data_file, tree->dicionario);
+}
+
+bool data_write_veiculo(BTree *tree, int rrn, Veiculo *veiculo) {
+    tree->escritas_registro++;
+    if (tree->dicionario != NULL) {
+        CompactVeiculo compacto;
+        bool dicionario_alterado;
+        bool ok = compact_encode(tree->dicionario, veiculo, &compacto, &dicionario_alterado);
+        if (dicionario_alterado) {
+            compact_write_header(tree->data_file, tree->dicionario);
+        }
+        if (!ok) {
+            printf("Dicionario do formato compacto cheio!\n");
+            return false;
+        }
+        fseek(tree->data_file, data_offset(tree->dicionario, rrn), SEEK_SET);
+        fwrite(&compacto, sizeof(CompactVeiculo), 1, tree->data_file);
+    } else {
+        fseek(tree->data_file, data_offset(NULL, rrn), SEEK_SET);
+        fwrite(veiculo, sizeof(Veiculo), 1, tree->data_file);
+    }
+    fflush(tree->data_file);
+    pool_atualizar(tree->pool, rrn, veiculo);
+    return true;
+}
+
+// Regrava o arquivo inteiro no formato pedido (via arquivo temporario).
+// Com 'expurgar', os registros *REMOVIDO* ficam de fora e os RRNs mudam.
+bool data_convert_file(const char *data_file, int formato, bool expurgar) {
+    FILE *origem = fopen(data_file, "rb");
+    if (!origem) {
+        printf("Arquivo %s nao encontrado!\n", data_file);
+        return false;
+    }
+    
+    char temporario[300];
+    sprintf(temporario, "%s.tmp", data_file);
+    FILE *destino = fopen(temporario, "w+b");
+    if (!destino) {
+        fclose(origem);
+        return false;
+    }
+    
+    CompactHeader *dicionario_origem = compact_read_header(origem);
+    int num_registros = data_num_registros_file(origem, dicionario_origem);
+    if (formato == FORMATO_ATUAL) {
+        formato = dicionario_origem != NULL ? FORMATO_COMPACTO : FORMATO_FIXO;
+    }
+    
+    CompactHeader *dicionario = NULL;
+    if (formato == FORMATO_COMPACTO) {
+        dicionario = (CompactHeader*)calloc(1, sizeof(CompactHeader));
+        memcpy(dicionario->magico, COMPACTO_MAGICO, sizeof(dicionario->magico));
+        compact_write_header(destino, dicionario);
+        fseek(destino, data_offset(dicionario, 0), SEEK_SET);
+    }
+    
+    Veiculo *bloco = (Veiculo*)malloc(BLOCO_PARTICAO * sizeof(Veiculo));
+    CompactVeiculo *compactos = (CompactVeiculo*)malloc(BLOCO_PARTICAO * sizeof(CompactVeiculo));
+    bool ok = true;
+    int gravados = 0;
+    
+    for (int primeiro = 0; ok && primeiro < num_registros; primeiro += BLOCO_PARTICAO) {
+        int lidos = data_read_block_file(origem, dicionario_origem, primeiro, BLOCO_PARTICAO, bloco);
+        if (expurgar) {
+            int mantidos = 0;
+            for (int i = 0; i < lidos; i++) {
+                if (strncmp(bloco[i].status, "*REMOVIDO*", TAMANHO_STATUS) == 0) continue;
+                bloco[mantidos++] = bloco[i];
+            }
+            lidos = mantidos;
+        }
+        gravados += lidos;
+        
+        if (dicionario == NULL) {
+            fwrite(bloco, sizeof(Veiculo), lidos, destino);
+            continue;
+        }
+        for (int i = 0; i < lidos; i++) {
+            bool alterado;
+            bloco[i].placa[TAMANHO_PLACA - 1] = '\0';
+            if (!compact_encode(dicionario, &bloco[i], &compactos[i], &alterado)) {
+                printf("Dicionario cheio no registro %d!\n", primeiro + i);
+                ok = false;
+                break;
+            }
+        }
+        if (ok) fwrite(compactos, sizeof(CompactVeiculo), lidos, destino);
+    }
+    
+    if (ok && dicionario != NULL) {
+        compact_write_header(destino, dicionario);
+        printf("Dicionarios: %d modelos, %d marcas, %d categorias, %d status\n",
+               dicionario->num_modelos, dicionario->num_marcas,
+               dicionario->num_categorias, dicionario->num_status);
+    }
+    
+    fclose(origem);
+    fclose(destino);
+    free(bloco);
+    free(compactos);
+    free(dicionario);
+    free(dicionario_origem);
+    
+    if (!ok || rename(temporario, data_file) != 0) {
+        remove(temporario);
+        return false;
+    }
+    if (expurgar) {
+        printf("%s expurgado: %d de %d registros mantidos\n", data_file, gravados, num_registros);
+    } else {
+        printf("%s convertido: %d registros no formato %s\n", data_file, num_registros,
+               formato == FORMATO_COMPACTO ? "compacto" : "fixo");
+    }
+    return true;
+}
+
+void data_print_veiculo(Veiculo *veiculo) {
+    printf("\n--- Dados do Veiculo ---\n");
+    printf("Placa: %s\n", veiculo->placa);
+    printf("Modelo: %s\n", veiculo->modelo);
+    printf("Marca: %s\n", veiculo->marca);
+    printf("Ano: %d\n", veiculo->ano);
+    printf("Categoria: %s\n", veiculo->categoria);
+    printf("Quilometragem: %d km\n", veiculo->quilometragem);
+    printf("Status: %s\n", veiculo->status);
+    printf("------------------------\n\n");
+}
+
+void btree_search(BTree *tree, const char *placa) {
+    if (tree->root_rrn == -1) {
+        printf("Arvore vazia!\n");
+        return;
+    }
+    
+    char placa_busca[100];
+    strncpy(placa_busca, placa, sizeof(placa_busca) - 1);
+    placa_busca[sizeof(placa_busca) - 1] = '\0';
+    normalizar_placa(placa_busca);
+    
+    printf("\nBuscando placa: '%s'\n", placa_busca);
+    
+    int data_rrn = btree_search_internal(tree, tree->root_rrn, placa_busca);
+    
+    if (data_rrn == -1) {
+        printf("Placa '%s' nao encontrada!\n", placa_busca);
+        return;
+    }
+    
+    printf("\nVeiculo encontrado!\n");
+    Veiculo veiculo;
+    if (data_read_veiculo(tree, data_rrn, &veiculo)) {
+        data_print_veiculo(&veiculo);
+    }
+}
+
+void data_mark_removed(BTree *tree, int rrn) {
+    Veiculo veiculo;
+    if (data_read_veiculo(tree, rrn, &veiculo)) {
+        cow_preserve_record(tree, &veiculo, rrn);
+        strcpy(veiculo.status, "*REMOVIDO*");
+        data_write_veiculo(tree, rrn, &veiculo);
+    }
+}
+
+// Snapshots
+// No modo bufferizado o snapshot guarda uma copia das mensagens pendentes
+// (a mais nova por placa, em ordem de placa) em vez de drenar os buffers
+void snapshot_capture_buffers(Snapshot *snap) {
+    BTree *tree = snap->tree;
+    snap->pendentes = NULL;
+    snap->num_pendentes = 0;
+    if (!tree->bufferizado || tree->mensagens_pendentes == 0) return;
+    
+    int quantidade = buffer_collect(tree, &snap->pendentes, false);
+    qsort(snap->pendentes, quantidade, sizeof(Mensagem), comparar_mensagens);
+    
+    int mantidas = 0;
+    for (int i = 0; i < quantidade; i++) {
+        if (i + 1 < quantidade &&
+            strncmp(snap->pendentes[i].placa, snap->pendentes[i + 1].placa, TAMANHO_PLACA) == 0) {
+            continue;
+        }
+        snap->pendentes[mantidas++] = snap->pendentes[i];
+    }
+    snap->num_pendentes = mantidas;
+}
+
+Snapshot* snapshot_open(BTree *tree) {
+    pthread_mutex_lock(&tree->trava);
+    
+    Snapshot *snap = (Snapshot*)malloc(sizeof(Snapshot));
+    snap->tree = tree;
+    snap->epoch = ++tree->epoch;
+    snap->root_rrn = tree->root_rrn;
+    snap->next_rrn = tree->next_rrn;
+    snap->num_registros = data_num_registros(tree);
+    snapshot_capture_buffers(snap);
+    snap->next = tree->snapshots;
+    tree->snapshots = snap;
+    
+    pthread_mutex_unlock(&tree->trava);
+    return snap;
+}
+
+void snapshot_close(Snapshot *snap) {
+    BTree *tree = snap->tree;
+    pthread_mutex_lock(&tree->trava);
+    
+    Snapshot **atual = &tree->snapshots;
+    while (*atual != NULL && *atual != snap) {
+        atual = &(*atual)->next;
+    }
+    if (*atual != NULL) {
+        *atual = snap->next;
+    }
+    free(snap->pendentes);
+    free(snap);
+    cow_reclaim(tree);
+    
+    pthread_mutex_unlock(&tree->trava);
+}
+
+bool snapshot_read_node(Snapshot *snap, int rrn, BTreeNode *node) {
+    if (rrn < 0 || rrn >= snap->next_rrn) return false;
+    
+    BTree *tree = snap->tree;
+    pthread_mutex_lock(&tree->trava);
+    
+    PageVersion *visivel = cow_visible_page(tree, rrn, snap->epoch);
+    *node = visivel != NULL ? visivel->page : *btree_read_node(tree, rrn);
+    
+    pthread_mutex_unlock(&tree->trava);
+    return true;
+}
+
+// Leitura em bloco: um fread do arquivo e depois as versoes guardadas por cima
+int snapshot_read_block(Snapshot *snap, int primeiro, int quantidade, Veiculo *veiculos) {
+    if (primeiro >= snap->num_registros) return 0;
+    if (primeiro + quantidade > snap->num_registros) {
+        quantidade = snap->num_registros - primeiro;
+    }
+    
+    BTree *tree = snap->tree;
+    pthread_mutex_lock(&tree->trava);
+    
+    int lidos = data_read_block(tree, primeiro, quantidade, veiculos);
+    for (int i = 0; i < lidos; i++) {
+        RecordVersion *visivel = cow_visible_record(tree, primeiro + i, snap->epoch);
+        if (visivel != NULL) {
+            veiculos[i] = visivel->veiculo;
+        }
+    }
+    
+    pthread_mutex_unlock(&tree->trava);
+    return lidos;
+}
+
+bool snapshot_read_veiculo(Snapshot *snap, int rrn, Veiculo *veiculo) {
+    if (rrn < 0 || rrn >= snap->num_registros) return false;
+    
+    BTree *tree = snap->tree;
+    pthread_mutex_lock(&tree->trava);
+    
+    RecordVersion *visivel = cow_visible_record(tree, rrn, snap->epoch);
+    bool ok = true;
+    if (visivel != NULL) {
+        *veiculo = visivel->veiculo;
+    } else {
+        ok = data_read_veiculo(tree, rrn, veiculo);
+    }
+    
+    pthread_mutex_unlock(&tree->trava);
+    return ok;
+}
+
+typedef bool (*ScanVisitor)(const char *placa, int rrn, void *contexto);
+
+// Percorre as chaves >= inicio em ordem de placa, como vistas pelo snapshot.
+// Para quando o visitante retorna false.
+bool snapshot_scan_node(Snapshot *snap, int rrn, const char *inicio, ScanVisitor visitar, void *contexto) {
+    BTreeNode node;
+    if (!snapshot_read_node(snap, rrn, &node)) return true;
+    
+    for (int i = 0; i <= node.num_keys; i++) {
+        bool antes_do_inicio = i < node.num_keys && strncmp(node.keys[i], inicio, TAMANHO_PLACA) < 0;
+        if (antes_do_inicio) continue;
+        
+        if (!node.is_leaf) {
+            if (!snapshot_scan_node(snap, node.children[i], inicio, visitar, contexto)) return false;
+        }
+        if (i < node.num_keys && node.rrns[i] >= 0) {
+            if (!visitar(node.keys[i], node.rrns[i], contexto)) return false;
+        }
+    }
+    return true;
+}
+
+// Intercala as mensagens pendentes do snapshot com as chaves da arvore
+typedef struct SobreposicaoContexto {
+    Snapshot *snap;
+    int proxima;
+    ScanVisitor visitar;
+    void *contexto;
+} SobreposicaoContexto;
+
+// Entrega as insercoes pendentes com placa < limite (NULL = todas)
+bool snapshot_emitir_pendentes(SobreposicaoContexto *sobreposicao, const char *limite) {
+    Snapshot *snap = sobreposicao->snap;
+    while (sobreposicao->proxima < snap->num_pendentes) {
+        Mensagem *m = &snap->pendentes[sobreposicao->proxima];
+        if (limite != NULL && strncmp(m->placa, limite, TAMANHO_PLACA) >= 0) return true;
+        sobreposicao->proxima++;
+        if (m->tipo == MSG_INSERIR && !sobreposicao->visitar(m->placa, m->rrn, sobreposicao->contexto)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool snapshot_visitar_sobreposto(const char *placa, int rrn, void *contexto) {
+    SobreposicaoContexto *sobreposicao = (SobreposicaoContexto*)contexto;
+    Snapshot *snap = sobreposicao->snap;
+    if (!snapshot_emitir_pendentes(sobreposicao, placa)) return false;
+    
+    if (sobreposicao->proxima < snap->num_pendentes &&
+        strncmp(snap->pendentes[sobreposicao->proxima].placa, placa, TAMANHO_PLACA) == 0) {
+        Mensagem *m = &snap->pendentes[sobreposicao->proxima++];
+        if (m->tipo == MSG_REMOVER) return true;
+        rrn = m->rrn;
+    }
+    return sobreposicao->visitar(placa, rrn, sobreposicao->contexto);
+}
+
+void snapshot_scan(Snapshot *snap, const char *inicio, ScanVisitor visitar, void *contexto) {
+    if (inicio == NULL) inicio = "";
+    if (snap->num_pendentes == 0) {
+        if (snap->root_rrn == -1) return;
+        snapshot_scan_node(snap, snap->root_rrn, inicio, visitar, contexto);
+        return;
+    }
+    
+    SobreposicaoContexto sobreposicao;
+    sobreposicao.snap = snap;
+    sobreposicao.proxima = 0;
+    sobreposicao.visitar = visitar;
+    sobreposicao.contexto = contexto;
+    while (sobreposicao.proxima < snap->num_pendentes &&
+           strncmp(snap->pendentes[sobreposicao.proxima].placa, inicio, TAMANHO_PLACA) < 0) {
+        sobreposicao.proxima++;
+    }
+    
+    if (snap->root_rrn == -1 ||
+        snapshot_scan_node(snap, snap->root_rrn, inicio, snapshot_visitar_sobreposto, &sobreposicao)) {
+        snapshot_emitir_pendentes(&sobreposicao, NULL);
+    }
+}
+
+typedef struct BackupContexto {
+    Snapshot *snap;
+    FILE *destino;
+    int copiados;
+} BackupContexto;
+
+bool snapshot_backup_visitar(const char *placa, int rrn, void *contexto) {
+    BackupContexto *backup = (BackupContexto*)contexto;
+    Veiculo veiculo;
+    (void)placa;
+    
+    if (snapshot_read_veiculo(backup->snap, rrn, &veiculo) &&
+        strcmp(veiculo.status, "*REMOVIDO*") != 0) {
+        fwrite(&veiculo, sizeof(Veiculo), 1, backup->destino);
+        backup->copiados++;
+    }
+    return true;
+}
+
+// Copia consistente dos veiculos indexados, em ordem de placa,
+// sem bloquear insercoes e remocoes durante a varredura
+int snapshot_backup(BTree *tree, const char *backup_file) {
+    FILE *destino = fopen(backup_file, "wb");
+    if (!destino) return -1;
+    
+    BackupContexto backup;
+    backup.snap = snapshot_open(tree);
+    backup.destino = destino;
+    backup.copiados = 0;
+    
+    snapshot_scan(backup.snap, NULL, snapshot_backup_visitar, &backup);
+    
+    snapshot_close(backup.snap);
+    fclose(destino);
+    return backup.copiados;
+}
+
+bool data_update_veiculo(BTree *tree, int rrn, Veiculo *veiculo) {
+    Veiculo anterior;
+    if (data_read_veiculo(tree, rrn, &anterior)) {
+        cow_preserve_record(tree, &anterior, rrn);
+    }
+    return data_write_veiculo(tree, rrn, veiculo);
+}
+
+// Arquivo do pool: cabecalho + uma PoolEntrada por RRN. 'limpo' fica 0
+// enquanto o indice esta aberto; um pool sujo ou de outro tamanho e
+// reconstruido a partir de veiculos.dat.
+void pool_salvar(BTree *tree, bool limpo) {
+    AvailabilityPool *pool = tree->pool;
+    FILE *arquivo = fopen(pool->filename, "wb");
+    if (!arquivo) return;
+    
+    pool->cabecalho.limpo = limpo ? 1 : 0;
+    pool->cabecalho.num_registros = data_num_registros(tree);
+    pool_garantir(pool, pool->cabecalho.num_registros);
+    fwrite(&pool->cabecalho, sizeof(PoolCabecalho), 1, arquivo);
+    if (limpo) {
+        fwrite(pool->entradas, sizeof(PoolEntrada), pool->cabecalho.num_registros, arquivo);
+    }
+    fclose(arquivo);
+}
+
+void pool_reconstruir(BTree *tree) {
+    AvailabilityPool *pool = tree->pool;
+    pool->cabecalho.num_categorias = 0;
+    for (int i = 0; i < pool->capacidade; i++) {
+        pool->entradas[i].proximo = -1;
+        pool->entradas[i].anterior = -1;
+        pool->entradas[i].categoria = -1;
+    }
+    
+    Veiculo *bloco = (Veiculo*)malloc(BLOCO_PARTICAO * sizeof(Veiculo));
+    int num_registros = data_num_registros(tree);
+    for (int primeiro = 0; primeiro < num_registros; primeiro += BLOCO_PARTICAO) {
+        int lidos = data_read_block(tree, primeiro, BLOCO_PARTICAO, bloco);
+        if (lidos == 0) break;
+        for (int i = 0; i < lidos; i++) {
+            if (bloco[i].placa[0] != '\0' && status_situacao(bloco[i].status) == SITUACAO_DISPONIVEL) {
+                pool_atualizar(pool, primeiro + i, &bloco[i]);
+            }
+        }
+    }
+    free(bloco);
+}
+
+bool pool_carregar(BTree *tree) {
+    AvailabilityPool *pool = tree->pool;
+    FILE *arquivo = fopen(pool->filename, "rb");
+    if (!arquivo) return false;
+    
+    bool ok = fread(&pool->cabecalho, sizeof(PoolCabecalho), 1, arquivo) == 1 &&
+              memcmp(pool->cabecalho.magico, POOL_MAGICO, sizeof(pool->cabecalho.magico)) == 0 &&
+              pool->cabecalho.limpo == 1 &&
+              pool->cabecalho.num_registros == data_num_registros(tree);
+    if (ok) {
+        pool_garantir(pool, pool->cabecalho.num_registros);
+        ok = (int)fread(pool->entradas, sizeof(PoolEntrada), pool->cabecalho.num_registros, arquivo)
+             == pool->cabecalho.num_registros;
+    }
+    fclose(arquivo);
+    return ok;
+}
+
+// carregar = false abre o pool vazio (btree_create o preenche durante a carga)
+void pool_abrir(BTree *tree, bool carregar) {
+    AvailabilityPool *pool = (AvailabilityPool*)calloc(1, sizeof(AvailabilityPool));
+    snprintf(pool->filename, sizeof(pool->filename), "%s.pool", tree->data_filename);
+    tree->pool = pool;
+    
+    if (carregar && !pool_carregar(tree)) {
+        pool_reconstruir(tree);
+    }
+    memcpy(pool->cabecalho.magico, POOL_MAGICO, sizeof(pool->cabecalho.magico));
+    pool_salvar(tree, false);
+}
+
+void pool_fechar(BTree *tree) {
+    pool_salvar(tree, true);
+    free(tree->pool->entradas);
+    free(tree->pool);
+    tree->pool = NULL;
+}
+
+// Retira o primeiro veiculo disponivel da categoria e marca como Alugado.
+// Entradas que o indice nao aponta mais (placa reinserida) sao descartadas.
+int btree_retirar(BTree *tree, const char *categoria, Veiculo *veiculo) {
+    pthread_mutex_lock(&tree->trava);
+    
+    int rrn = -1;
+    int c = pool_categoria(tree->pool, categoria, false);
+    while (c >= 0 && tree->pool->cabecalho.cabecas[c] != -1) {
+        int candidato = tree->pool->cabecalho.cabecas[c];
+        char placa[TAMANHO_PLACA];
+        bool lido = data_read_veiculo(tree, candidato, veiculo);
+        memcpy(placa, veiculo->placa, TAMANHO_PLACA);
+        placa[TAMANHO_PLACA - 1] = '\0';
+        normalizar_placa(placa);
+        if (!lido || btree_search_internal(tree, tree->root_rrn, placa) != candidato) {
+            pool_desligar(tree->pool, candidato);
+            continue;
+        }
+        
+        strncpy(veiculo->status, STATUS_ALUGADO, TAMANHO_STATUS);
+        if (data_update_veiculo(tree, candidato, veiculo)) {
+            rrn = candidato;
+        }
+        break;
+    }
+    
+    pthread_mutex_unlock(&tree->trava);
+    return rrn;
+}
+
+int btree_devolver(BTree *tree, const char *placa, Veiculo *veiculo) {
+    pthread_mutex_lock(&tree->trava);
+    
+    int status = RESP_NAO_ENCONTRADO;
+    int rrn = btree_search_internal(tree, tree->root_rrn, placa);
+    if (rrn != -1 && data_read_veiculo(tree, rrn, veiculo)) {
+        status = RESP_ERRO;
+        if (status_situacao(veiculo->status) == SITUACAO_ALUGADO) {
+            strncpy(veiculo->status, STATUS_DISPONIVEL, TAMANHO_STATUS);
+            if (data_update_veiculo(tree, rrn, veiculo)) {
+                status = RESP_OK;
+            }
+        }
+    }
+    
+    pthread_mutex_unlock(&tree->trava);
+    return status;
+}
+
+// Exportacao: blocos grandes lidos do snapshot, formatados em paralelo por
+// emissores proprios (sem printf) e gravados na ordem original
+char* emit_str(char *p, const char *s, int max) {
+    for (int i = 0; i < max && s[i] != '\0'; i++) {
+        *p++ = s[i];
+    }
+    return p;
+}
+
+char* emit_lit(char *p, const char *s) {
+    while (*s != '\0') *p++ = *s++;
+    return p;
+}
+
+char* emit_int(char *p, int valor) {
+    char digitos[12];
+    int n = 0;
+    unsigned int v = valor < 0 ? -(unsigned int)valor : (unsigned int)valor;
+    
+    if (valor < 0) *p++ = '-';
+    do {
+        digitos[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    while (n > 0) *p++ = digitos[--n];
+    return p;
+}
+
+char* emit_csv_str(char *p, const char *s, int max) {
+    bool aspas = false;
+    for (int i = 0; i < max && s[i] != '\0'; i++) {
+        if (s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r') {
+            aspas = true;
+            break;
+        }
+    }
+    if (!aspas) return emit_str(p, s, max);
+    
+    *p++ = '"';
+    for (int i = 0; i < max && s[i] != '\0'; i++) {
+        if (s[i] == '"') *p++ = '"';
+        *p++ = s[i];
+    }
+    *p++ = '"';
+    return p;
+}
+
+char* emit_json_str(char *p, const char *s, int max) {
+    static const char hex[] = "0123456789abcdef";
+    *p++ = '"';
+    for (int i = 0; i < max && s[i] != '\0'; i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        } else if (c < 0x20) {
+            p = emit_lit(p, "\\u00");
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 0xf];
+        } else {
+            *p++ = c;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+// Escreve um registro em p (ate EXPORT_MAX_REGISTRO bytes) e retorna o fim
+char* export_formatar(int formato, const Veiculo *v, int rrn, char *p) {
+    switch (formato) {
+        case EXPORT_CSV:
+            p = emit_int(p, rrn);
+            *p++ = ',';
+            p = emit_csv_str(p, v->placa, TAMANHO_PLACA);
+            *p++ = ',';
+            p = emit_csv_str(p, v->modelo, TAMANHO_MODELO);
+            *p++ = ',';
+            p = emit_csv_str(p, v->marca, TAMANHO_MARCA);
+            *p++ = ',';
+            p = emit_int(p, v->ano);
+            *p++ = ',';
+            p = emit_csv_str(p, v->categoria, TAMANHO_CATEGORIA);
+            *p++ = ',';
+            p = emit_int(p, v->quilometragem);
+            *p++ = ',';
+            p = emit_csv_str(p, v->status, TAMANHO_STATUS);
+            *p++ = '\n';
+            break;
+            
+        case EXPORT_JSONL:
+            p = emit_lit(p, "{\"rrn\":");
+            p = emit_int(p, rrn);
+            p = emit_lit(p, ",\"placa\":");
+            p = emit_json_str(p, v->placa, TAMANHO_PLACA);
+            p = emit_lit(p, ",\"modelo\":");
+            p = emit_json_str(p, v->modelo, TAMANHO_MODELO);
+            p = emit_lit(p, ",\"marca\":");
+            p = emit_json_str(p, v->marca, TAMANHO_MARCA);
+            p = emit_lit(p, ",\"ano\":");
+            p = emit_int(p, v->ano);
+            p = emit_lit(p, ",\"categoria\":");
+            p = emit_json_str(p, v->categoria, TAMANHO_CATEGORIA);
+            p = emit_lit(p, ",\"quilometragem\":");
+            p = emit_int(p, v->quilometragem);
+            p = emit_lit(p, ",\"status\":");
+            p = emit_json_str(p, v->status, TAMANHO_STATUS);
+            p = emit_lit(p, "}\n");
+            break;
+            
+        default:
+            p = emit_lit(p, "----------------------------------------\nRNN: ");
+            p = emit_int(p, rrn);
+            p = emit_lit(p, "\nPlaca: ");
+            p = emit_str(p, v->placa, TAMANHO_PLACA);
+            p = emit_lit(p, "\nModelo: ");
+            p = emit_str(p, v->modelo, TAMANHO_MODELO);
+            p = emit_lit(p, "\nMarca: ");
+            p = emit_str(p, v->marca, TAMANHO_MARCA);
+            p = emit_lit(p, "\nAno: ");
+            p = emit_int(p, v->ano);
+            p = emit_lit(p, "\nCategoria: ");
+            p = emit_str(p, v->categoria, TAMANHO_CATEGORIA);
+            p = emit_lit(p, "\nQuilometragem: ");
+            p = emit_int(p, v->quilometragem);
+            p = emit_lit(p, " km\nStatus: ");
+            p = emit_str(p, v->status, TAMANHO_STATUS);
+            p = emit_lit(p, "\n----------------------------------------\n\n");
+    }
+    return p;
+}
+
+typedef struct ExportLote {
+    Veiculo *veiculos;
+    int *rrns;
+    int quantidade;
+    int formato;
+    char *saida;
+    size_t tamanho;
+    int exportados;
+} ExportLote;
+
+void* export_formatar_lote(void *arg) {
+    ExportLote *lote = (ExportLote*)arg;
+    char *p = lote->saida;
+    lote->exportados = 0;
+    
+    for (int i = 0; i < lote->quantidade; i++) {
+        if (strncmp(lote->veiculos[i].status, "*REMOVIDO*", TAMANHO_STATUS) == 0) continue;
+        p = export_formatar(lote->formato, &lote->veiculos[i], lote->rrns[i], p);
+        lote->exportados++;
+    }
+    lote->tamanho = p - lote->saida;
+    return NULL;
+}
+
+typedef struct ExportOrdem {
+    int *rrns;
+    int quantidade;
+    int capacidade;
+} ExportOrdem;
+
+bool export_coletar_rrn(const char *placa, int rrn, void *contexto) {
+    ExportOrdem *ordem = (ExportOrdem*)contexto;
+    (void)placa;
+    
+    if (ordem->quantidade == ordem->capacidade) {
+        ordem->capacidade = ordem->capacidade > 0 ? ordem->capacidade * 2 : 4096;
+        ordem->rrns = (int*)realloc(ordem->rrns, ordem->capacidade * sizeof(int));
+    }
+    ordem->rrns[ordem->quantidade++] = rrn;
+    return true;
+}
+
+int export_num_threads() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    if (cpus > EXPORT_MAX_THREADS) return EXPORT_MAX_THREADS;
+    return cpus;
+}
+
+// Exporta os veiculos visiveis em um snapshot, em ordem fisica (RRN) ou de placa
+long export_tree(BTree *tree, FILE *saida, int formato, bool ordem_indice) {
+    Snapshot *snap = snapshot_open(tree);
+    
+    ExportOrdem ordem;
+    memset(&ordem, 0, sizeof(ordem));
+    int total = snap->num_registros;
+    if (ordem_indice) {
+        snapshot_scan(snap, NULL, export_coletar_rrn, &ordem);
+        total = ordem.quantidade;
+    }
+    
+    if (formato == EXPORT_CSV) {
+        fputs("rrn,placa,modelo,marca,ano,categoria,quilometragem,status\n", saida);
+    }
+    
+    int num_threads = export_num_threads();
+    ExportLote lotes[EXPORT_MAX_THREADS];
+    pthread_t threads[EXPORT_MAX_THREADS];
+    for (int t = 0; t < num_threads; t++) {
+        lotes[t].veiculos = (Veiculo*)malloc(EXPORT_BLOCO * sizeof(Veiculo));
+        lotes[t].rrns = (int*)malloc(EXPORT_BLOCO * sizeof(int));
+        lotes[t].saida = (char*)malloc((size_t)EXPORT_BLOCO * EXPORT_MAX_REGISTRO);
+        lotes[t].formato = formato;
+    }
+    
+    long exportados = 0;
+    int pos = 0;
+    
+    while (pos < total) {
+        int usados = 0;
+        for (; usados < num_threads && pos < total; usados++) {
+            ExportLote *lote = &lotes[usados];
+            int n = total - pos < EXPORT_BLOCO ? total - pos : EXPORT_BLOCO;
+            lote->quantidade = 0;
+            
+            if (ordem_indice) {
+                for (int i = 0; i < n; i++) {
+                    int rrn = ordem.rrns[pos + i];
+                    if (snapshot_read_veiculo(snap, rrn, &lote->veiculos[lote->quantidade])) {
+                        lote->rrns[lote->quantidade++] = rrn;
+                    }
+                }
+            } else {
+                lote->quantidade = snapshot_read_block(snap, pos, n, lote->veiculos);
+                for (int i = 0; i < lote->quantidade; i++) {
+                    lote->rrns[i] = pos + i;
+                }
+            }
+            pos += n;
+        }
+        
+        bool criada[EXPORT_MAX_THREADS];
+        for (int t = 0; t < usados; t++) {
+            criada[t] = usados > 1 && pthread_create(&threads[t], NULL, export_formatar_lote, &lotes[t]) == 0;
+            if (!criada[t]) export_formatar_lote(&lotes[t]);
+        }
+        for (int t = 0; t < usados; t++) {
+            if (criada[t]) pthread_join(threads[t], NULL);
+            fwrite(lotes[t].saida, 1, lotes[t].tamanho, saida);
+            exportados += lotes[t].exportados;
+        }
+    }
+    
+    for (int t = 0; t < num_threads; t++) {
+        free(lotes[t].veiculos);
+        free(lotes[t].rrns);
+        free(lotes[t].saida);
+    }
+    free(ordem.rrns);
+    snapshot_close(snap);
+    fflush(saida);
+    return exportados;
+}
+
+void text_append_veiculo(BTree *tree, Veiculo *veiculo, int rrn) {
+    char registro[EXPORT_MAX_REGISTRO];
+    char *fim = export_formatar(EXPORT_TEXTO, veiculo, rrn, registro);
+    fwrite(registro, 1, fim - registro, tree->text_file);
+    fflush(tree->text_file);
+}
+
+void text_rebuild_file(BTree *tree) {
+    fclose(tree->text_file);
+    tree->text_file = fopen(tree->text_filename, "w");
+    
+    fprintf(tree->text_file, "========================================\n");
+    fprintf(tree->text_file, "   SISTEMA DE LOCACAO DE VEICULOS\n");
+    fprintf(tree->text_file, "========================================\n\n");
+    
+    export_tree(tree, tree->text_file, EXPORT_TEXTO, false);
+}
+
+// Remocao sem printf (devolve um codigo REMOCAO_*), usada pelo menu e pelo
+// servidor. O indice muda antes do registro ser marcado.
+int btree_remove_key(BTree *tree, const char *placa) {
+    if (tree->root_rrn == -1) {
+        return REMOCAO_ARVORE_VAZIA;
+    }
+    
+    int data_rrn = btree_search_internal(tree, tree->root_rrn, placa);
+    
+    if (data_rrn == -1) {
+        return REMOCAO_NAO_ENCONTRADA;
+    }
+    
+    // O indice muda primeiro: chave de folha sai da folha, chave de no
+    // interno vira separador com RRN -1. So entao o registro e marcado.
+    Mensagem mensagem;
+    mensagem_preencher(tree, &mensagem, placa, -1, MSG_REMOVER);
+    if (tree->bufferizado) {
+        btree_buffered_message(tree, &mensagem);
+    } else {
+        btree_apply_direct(tree, &mensagem);
+    }
+    
+    data_mark_removed(tree, data_rrn);
+    return REMOCAO_OK;
+}
+
+bool btree_remove(BTree *tree, const char *placa) {
+    switch (btree_remove_key(tree, placa)) {
+        case REMOCAO_OK:
+            printf("Veiculo removido com sucesso!\n");
+            text_rebuild_file(tree);
+            return true;
+        case REMOCAO_ARVORE_VAZIA:
+            printf("Arvore vazia!\n");
+            return false;
+        case REMOCAO_NAO_ENCONTRADA:
+            printf("Placa '%s' nao encontrada!\n", placa);
+            return false;
+        default:
+            return false;
+    }
+}
+
+void btree_print_node(Snapshot *snap, int rrn, int level) {
+    BTreeNode node;
+    if (!snapshot_read_node(snap, rrn, &node)) return;
+    
+    for (int i = 0; i < level; i++) printf("  ");
     printf("RNN=%d [", rrn);
     
-    for (int i = 0; i < node->num_keys; i++) {
-        printf("%s", node->keys[i]);
-        if (i < node->num_keys - 1) printf(", ");
+    // Separador com RRN -1 e uma placa removida que so guia a descida
+    for (int i = 0; i < node.num_keys; i++) {
+        printf(node.rrns[i] < 0 ? "(%s removida)" : "%s", node.keys[i]);
+        if (i < node.num_keys - 1) printf(", ");
+    }
+    printf("]\n");
+    
+    if (!node.is_leaf) {
+        for (int i = 0; i <= node.num_keys; i++) {
+            btree_print_node(snap, node.children[i], level + 1);
+        }
+    }
+}
+
+void btree_print(BTree *tree) {
+    if (tree->root_rrn == -1) {
+        printf("Arvore vazia!\n");
+        return;
+    }
+    
+    printf("\n=== Estrutura da Arvore B ===\n");
+    Snapshot *snap = snapshot_open(tree);
+    btree_print_node(snap, snap->root_rrn, 0);
+    snapshot_close(snap);
+    
+    printf("\n=== Cache (%d/%d) ===\n", tree->page_queue->size, P);
+    PageQueueNode *current = tree->page_queue->front;
+    int pos = 1;
+    while (current != NULL) {
+        printf("%d. RNN=%d %s\n", pos++, current->rrn, 
+               current->page->modified ? "[MOD]" : "");
+        current = current->next;
+    }
+    
+    PoolCabecalho *pool = &tree->pool->cabecalho;
+    printf("\n=== Disponiveis por categoria ===\n");
+    for (int i = 0; i < pool->num_categorias; i++) {
+        printf("%-15s %d\n", pool->categorias[i], pool->disponiveis[i]);
+    }
+    printf("\n");
+}
+
+int data_insert_veiculo(BTree *tree, Veiculo *veiculo) {
+    int rrn = data_num_registros(tree);
+    
+    if (!data_write_veiculo(tree, rrn, veiculo)) {
+        return -1;
+    }
+    
+    text_append_veiculo(tree, veiculo, rrn);
+    
+    return rrn;
+}
+
+void btree_load_from_data_file(BTree *tree) {
+    int num_registros = data_num_registros(tree);
+    
+    if (num_registros == 0) {
+        printf("Arquivo de dados vazio!\n");
+        return;
+    }
+    
+    printf("\nCarregando veiculos do arquivo veiculos.dat...\n");
+    printf("Total de registros: %d\n\n", num_registros);
+    
+    Veiculo *bloco = (Veiculo*)malloc(BLOCO_PARTICAO * sizeof(Veiculo));
+    int no_bloco = 0;
+    int lidos_bloco = 0;
+    
+    int carregados = 0;
+    
+    for (int rrn = 0; rrn < num_registros; rrn++) {
+        if (no_bloco == lidos_bloco) {
+            lidos_bloco = data_read_block(tree, rrn, BLOCO_PARTICAO, bloco);
+            no_bloco = 0;
+            if (lidos_bloco == 0) break;
+        }
+        Veiculo veiculo = bloco[no_bloco++];
+        
+        veiculo.placa[TAMANHO_PLACA - 1] = '\0';
+        veiculo.modelo[TAMANHO_MODELO - 1] = '\0';
+        veiculo.marca[TAMANHO_MARCA - 1] = '\0';
+        veiculo.categoria[TAMANHO_CATEGORIA - 1] = '\0';
+        veiculo.status[TAMANHO_STATUS - 1] = '\0';
+        
+        normalizar_placa(veiculo.placa);
+        
+        int placa_valida = 0;
+        for (int i = 0; i < TAMANHO_PLACA; i++) {
+            if ((veiculo.placa[i] >= 'A' && veiculo.placa[i] <= 'Z') ||
+                (veiculo.placa[i] >= '0' && veiculo.placa[i] <= '9')) {
+                placa_valida = 1;
+                break;
+            }
+        }
+        
+        if (!placa_valida) {
+            continue;
+        }
+        
+        if (strstr(veiculo.status, "REMOVIDO") != NULL) {
+            continue;
+        }
+        
+        btree_insert(tree, veiculo.placa, rrn);
+        pool_atualizar(tree->pool, rrn, &veiculo);
+        carregados++;
+    }
+    
+    free(bloco);
+    text_rebuild_file(tree);
+    printf("Veiculos carregados: %d\n\n", carregados);
+}
+
+void btree_reset_io(BTree *tree) {
+    tree->leituras_pagina = 0;
+    tree->escritas_pagina = 0;
+    tree->leituras_registro = 0;
+    tree->escritas_registro = 0;
+    tree->leituras_buffer = 0;
+    tree->escritas_buffer = 0;
+}
+
+void btree_init_buffers(BTree *tree) {
+    snprintf(tree->buffer_filename, sizeof(tree->buffer_filename), "%s.buf", tree->index_filename);
+    tree->bufferizado = false;
+    tree->buffer_file = NULL;
+    tree->buffer_cache = NULL;
+    tree->buffer_pendente = NULL;
+    tree->buffer_pendente_capacidade = 0;
+    tree->mensagens_pendentes = 0;
+    tree->proxima_sequencia = 0;
+    tree->pool = NULL;
+}
+
+void btree_init_versions(BTree *tree) {
+    pthread_mutexattr_t atributos;
+    pthread_mutexattr_init(&atributos);
+    pthread_mutexattr_settype(&atributos, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&tree->trava, &atributos);
+    pthread_mutexattr_destroy(&atributos);
+    
+    tree->epoch = 0;
+    tree->snapshots = NULL;
+    for (int b = 0; b < VERSOES_BUCKETS; b++) {
+        tree->page_versions[b] = NULL;
+        tree->record_versions[b] = NULL;
+    }
+}
+
+BTree* btree_create(const char *index_file, const char *data_file, const char *text_file) {
+    BTree *tree = (BTree*)malloc(sizeof(BTree));
+    strcpy(tree->index_filename, index_file);
+    strcpy(tree->data_filename, data_file);
+    strcpy(tree->text_filename, text_file);
+    
+    tree->index_file = fopen(index_file, "wb+");
+    if (!tree->index_file) {
+        free(tree);
+        return NULL;
+    }
+    
+    tree->data_file = fopen(data_file, "rb+");
+    if (!tree->data_file) {
+        tree->data_file = fopen(data_file, "wb+");
+    }
+    
+    tree->text_file = fopen(text_file, "w");
+    if (!tree->text_file) {
+        fclose(tree->index_file);
+        fclose(tree->data_file);
+        free(tree);
+        return NULL;
+    }
+    
+    tree->dicionario = compact_read_header(tree->data_file);
+    
+    fprintf(tree->text_file, "========================================\n");
+    fprintf(tree->text_file, "   SISTEMA DE LOCACAO DE VEICULOS\n");
+    fprintf(tree->text_file, "========================================\n\n");
+    fflush(tree->text_file);
+    
+    tree->root_rrn = -1;
+    tree->next_rrn = 0;
+    tree->page_queue = queue_create();
+    btree_init_versions(tree);
+    btree_init_buffers(tree);
+    btree_reset_io(tree);
+    remove(tree->buffer_filename);
+    
+    fwrite(&tree->root_rrn, sizeof(int), 1, tree->index_file);
+    fwrite(&tree->next_rrn, sizeof(int), 1, tree->index_file);
+    fflush(tree->index_file);
+    
+    printf("Sistema criado! (M=%d, Cache=%d paginas)\n", M, P);
+    
+    pool_abrir(tree, false);
+    btree_load_from_data_file(tree);
+    
+    return tree;
+}
+
+BTree* btree_load(const char *index_file, const char *data_file, const char *text_file) {
+    BTree *tree = (BTree*)malloc(sizeof(BTree));
+    strcpy(tree->index_filename, index_file);
+    strcpy(tree->data_filename, data_file);
+    strcpy(tree->text_filename, text_file);
+    
+    tree->index_file = fopen(index_file, "rb+");
+    if (!tree->index_file) {
+        free(tree);
+        return NULL;
+    }
+    
+    tree->data_file = fopen(data_file, "rb+");
+    if (!tree->data_file) {
+        fclose(tree->index_file);
+        free(tree);
+        return NULL;
+    }
+    
+    tree->text_file = fopen(text_file, "a");
+    if (!tree->text_file) {
+        fclose(tree->index_file);
+        fclose(tree->data_file);
+        free(tree);
+        return NULL;
+    }
+    
+    tree->dicionario = compact_read_header(tree->data_file);
+    
+    fread(&tree->root_rrn, sizeof(int), 1, tree->index_file);
+    fread(&tree->next_rrn, sizeof(int), 1, tree->index_file);
+    tree->page_queue = queue_create();
+    btree_init_versions(tree);
+    btree_init_buffers(tree);
+    btree_reset_io(tree);
+    
+    // Um arquivo de buffers indica que o indice foi fechado em modo bufferizado
+    FILE *buffers = fopen(tree->buffer_filename, "rb");
+    if (buffers) {
+        fclose(buffers);
+        btree_set_buffered(tree, true);
+    }
+    pool_abrir(tree, true);
+    
+    printf("Sistema carregado! (Raiz RNN=%d)\n", tree->root_rrn);
+    return tree;
+}
+
+void btree_close(BTree *tree) {
+    if (tree) {
+        if (tree->pool) {
+            pool_fechar(tree);
+        }
+        
+        if (tree->bufferizado) {
+            buffer_sync(tree);
+            fclose(tree->buffer_file);
+            free(tree->buffer_cache);
+            free(tree->buffer_pendente);
+        }
+        
+        PageQueueNode *current = tree->page_queue->front;
+        while (current != NULL) {
+            if (current->page->modified) {
+                btree_write_node(tree, current->page, current->rrn);
+            }
+            current = current->next;
+        }
+        
+        if (tree->index_file) {
+            fseek(tree->index_file, 0, SEEK_SET);
+            fwrite(&tree->root_rrn, sizeof(int), 1, tree->index_file);
+            fwrite(&tree->next_rrn, sizeof(int), 1, tree->index_file);
+            fclose(tree->index_file);
+        }
+        
+        if (tree->data_file) {
+            fclose(tree->data_file);
+        }
+        
+        if (tree->text_file) {
+            fclose(tree->text_file);
+        }
+        
+        queue_destroy(tree->page_queue);
+        free(tree->dicionario);
+        while (tree->snapshots != NULL) {
+            Snapshot *snap = tree->snapshots;
+            tree->snapshots = snap->next;
+            free(snap);
+        }
+        cow_reclaim(tree);
+        pthread_mutex_destroy(&tree->trava);
+        free(tree);
+        printf("Sistema fechado!\n");
+    }
+}
+
+double agora_segundos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool copiar_arquivo(const char *origem, const char *destino) {
+    FILE *entrada = fopen(origem, "rb");
+    if (!entrada) return false;
+    FILE *saida = fopen(destino, "wb");
+    if (!saida) {
+        fclose(entrada);
+        return false;
+    }
+    
+    char *bloco = (char*)malloc(TRACE_BUFFER);
+    size_t lidos;
+    while ((lidos = fread(bloco, 1, TRACE_BUFFER, entrada)) > 0) {
+        fwrite(bloco, 1, lidos, saida);
+    }
+    free(bloco);
+    fclose(entrada);
+    fclose(saida);
+    return true;
+}
+
+void trace_nome_dados(char *destino, const char *trace_file, int shard) {
+    sprintf(destino, "%s.s%d.dat", trace_file, shard);
+}
+
+// Gravacao de trace: ativada pela variavel de ambiente LOCADORA_TRACE.
+// Copia o arquivo de dados de cada shard antes da primeira operacao, para
+// que o replay parta do mesmo estado.
+TraceRecorder* trace_open(const char *trace_file, ShardedBTree *frota) {
+    for (int s = 0; s < frota->num_shards; s++) {
+        char copia[300];
+        trace_nome_dados(copia, trace_file, s);
+        fflush(frota->shards[s]->data_file);
+        if (!copiar_arquivo(frota->shards[s]->data_filename, copia)) {
+            printf("Falha ao copiar %s para o trace!\n", frota->shards[s]->data_filename);
+            return NULL;
+        }
+    }
+    
+    FILE *arquivo = fopen(trace_file, "wb");
+    if (!arquivo) return NULL;
+    
+    TraceRecorder *trace = (TraceRecorder*)malloc(sizeof(TraceRecorder));
+    trace->arquivo = arquivo;
+    trace->buffer = (char*)malloc(TRACE_BUFFER);
+    setvbuf(arquivo, trace->buffer, _IOFBF, TRACE_BUFFER);
+    pthread_mutex_init(&trace->trava, NULL);
+    trace->inicio = agora_segundos();
+    trace->registros = 0;
+    
+    fwrite(TRACE_MAGICO, 4, 1, arquivo);
+    fwrite(&frota->num_shards, sizeof(int), 1, arquivo);
+    fwrite(&frota->modo, sizeof(int), 1, arquivo);
+    printf("Gravando trace em %s\n", trace_file);
+    return trace;
+}
+
+void trace_record_marcado(TraceRecorder *trace, uint8_t op, uint8_t marcas, double inicio, const void *argumento, uint16_t tamanho) {
+    if (trace == NULL) return;
+    
+    double fim = agora_segundos();
+    TraceCabecalho registro;
+    registro.timestamp_ns = (uint64_t)((inicio - trace->inicio) * 1e9);
+    registro.duracao_us = (uint32_t)((fim - inicio) * 1e6);
+    registro.op = op;
+    registro.marcas = marcas;
+    registro.tamanho = tamanho;
+    
+    pthread_mutex_lock(&trace->trava);
+    fwrite(&registro, sizeof(registro), 1, trace->arquivo);
+    if (tamanho > 0) fwrite(argumento, tamanho, 1, trace->arquivo);
+    trace->registros++;
+    pthread_mutex_unlock(&trace->trava);
+}
+
+void trace_record(TraceRecorder *trace, uint8_t op, double inicio, const void *argumento, uint16_t tamanho) {
+    trace_record_marcado(trace, op, 0, inicio, argumento, tamanho);
+}
+
+void trace_close(TraceRecorder *trace) {
+    if (trace == NULL) return;
+    fclose(trace->arquivo);
+    free(trace->buffer);
+    pthread_mutex_destroy(&trace->trava);
+    printf("Trace encerrado: %ld operacoes\n", trace->registros);
+    free(trace);
+}
+
+// Particionamento (shards)
+int shard_de_placa(ShardedBTree *frota, const char *placa) {
+    if (frota->num_shards <= 1) return 0;
+    
+    if (frota->modo == SHARD_POR_PREFIXO) {
+        char c = placa[0];
+        if (c < 'A' || c > 'Z') return 0;
+        return (c - 'A') * frota->num_shards / 26;
+    }
+    
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < TAMANHO_PLACA && placa[i] != '\0'; i++) {
+        hash ^= (unsigned char)placa[i];
+        hash *= 16777619u;
+    }
+    return hash % frota->num_shards;
+}
+
+void shard_nome_arquivo(char *destino, const char *base, const char *extensao, int shard, int num_shards) {
+    if (num_shards <= 1) {
+        sprintf(destino, "%s.%s", base, extensao);
+    } else {
+        sprintf(destino, "%s_s%d.%s", base, shard, extensao);
+    }
+}
+
+bool shard_particionar_dados(ShardedBTree *frota, const char *data_file) {
+    FILE *origem = fopen(data_file, "rb");
+    if (!origem) {
+        printf("Arquivo %s nao encontrado!\n", data_file);
+        return false;
+    }
+    
+    CompactHeader *dicionario = compact_read_header(origem);
+    int num_registros = data_num_registros_file(origem, dicionario);
+    
+    FILE *destinos[MAX_SHARDS];
+    for (int s = 0; s < frota->num_shards; s++) {
+        char nome[256];
+        shard_nome_arquivo(nome, "veiculos", "dat", s, frota->num_shards);
+        destinos[s] = fopen(nome, "wb");
+        if (!destinos[s]) {
+            for (int j = 0; j < s; j++) fclose(destinos[j]);
+            fclose(origem);
+            free(dicionario);
+            return false;
+        }
+    }
+    
+    Veiculo *bloco = (Veiculo*)malloc(BLOCO_PARTICAO * sizeof(Veiculo));
+    int contagem[MAX_SHARDS] = {0};
+    
+    for (int primeiro = 0; primeiro < num_registros; primeiro += BLOCO_PARTICAO) {
+        int lidos = data_read_block_file(origem, dicionario, primeiro, BLOCO_PARTICAO, bloco);
+        for (int i = 0; i < lidos; i++) {
+            char placa[TAMANHO_PLACA + 1];
+            memcpy(placa, bloco[i].placa, TAMANHO_PLACA);
+            placa[TAMANHO_PLACA] = '\0';
+            normalizar_placa(placa);
+            
+            int s = shard_de_placa(frota, placa);
+            fwrite(&bloco[i], sizeof(Veiculo), 1, destinos[s]);
+            contagem[s]++;
+        }
+    }
+    
+    free(bloco);
+    fclose(origem);
+    for (int s = 0; s < frota->num_shards; s++) {
+        fclose(destinos[s]);
+        printf("Shard %d: %d registros\n", s, contagem[s]);
+    }
+    
+    // Os shards herdam o formato da origem, cada um com seus dicionarios
+    if (dicionario != NULL) {
+        for (int s = 0; s < frota->num_shards; s++) {
+            char nome[256];
+            shard_nome_arquivo(nome, "veiculos", "dat", s, frota->num_shards);
+            data_convert_file(nome, FORMATO_COMPACTO, false);
+        }
+        free(dicionario);
+    }
+    return true;
+}
+
+typedef struct ShardTarefa {
+    ShardedBTree *frota;
+    int shard;
+    bool criar;
+    void (*operacao)(BTree *tree, void *argumento);
+    void *argumento;
+} ShardTarefa;
+
+void* shard_abrir_thread(void *arg) {
+    ShardTarefa *tarefa = (ShardTarefa*)arg;
+    ShardedBTree *frota = tarefa->frota;
+    char idx[256], dat[256], txt[256];
+    
+    shard_nome_arquivo(idx, "btree_M", "idx", tarefa->shard, frota->num_shards);
+    shard_nome_arquivo(dat, "veiculos", "dat", tarefa->shard, frota->num_shards);
+    shard_nome_arquivo(txt, "veiculos", "txt", tarefa->shard, frota->num_shards);
+    
+    if (tarefa->criar) {
+        frota->shards[tarefa->shard] = btree_create(idx, dat, txt);
+    } else {
+        frota->shards[tarefa->shard] = btree_load(idx, dat, txt);
+    }
+    return NULL;
+}
+
+void* shard_operacao_thread(void *arg) {
+    ShardTarefa *tarefa = (ShardTarefa*)arg;
+    tarefa->operacao(tarefa->frota->shards[tarefa->shard], tarefa->argumento);
+    return NULL;
+}
+
+// Executa uma thread por shard e espera todas terminarem
+void sharded_executar(ShardedBTree *frota, void* (*rotina)(void*), bool criar,
+                      void (*operacao)(BTree*, void*), void *argumento) {
+    ShardTarefa tarefas[MAX_SHARDS];
+    pthread_t threads[MAX_SHARDS];
+    
+    for (int s = 0; s < frota->num_shards; s++) {
+        tarefas[s].frota = frota;
+        tarefas[s].shard = s;
+        tarefas[s].criar = criar;
+        tarefas[s].operacao = operacao;
+        tarefas[s].argumento = argumento;
+    }
+    
+    if (frota->num_shards == 1) {
+        rotina(&tarefas[0]);
+        return;
+    }
+    
+    for (int s = 0; s < frota->num_shards; s++) {
+        if (pthread_create(&threads[s], NULL, rotina, &tarefas[s]) != 0) {
+            rotina(&tarefas[s]);
+            threads[s] = 0;
+        }
+    }
+    for (int s = 0; s < frota->num_shards; s++) {
+        if (threads[s] != 0) pthread_join(threads[s], NULL);
+    }
+}
+
+void sharded_fan_out(ShardedBTree *frota, void (*operacao)(BTree*, void*), void *argumento) {
+    sharded_executar(frota, shard_operacao_thread, false, operacao, argumento);
+}
+
+void sharded_close(ShardedBTree *frota);
+
+// Le numero de shards e modo de btree_M.part; false se nao houver particoes
+bool sharded_ler_config(ShardedBTree *frota) {
+    strcpy(frota->config_filename, "btree_M.part");
+    FILE *config = fopen(frota->config_filename, "rb");
+    if (!config) return false;
+    
+    bool ok = fread(&frota->num_shards, sizeof(int), 1, config) == 1 &&
+              fread(&frota->modo, sizeof(int), 1, config) == 1 &&
+              frota->num_shards >= 1 && frota->num_shards <= MAX_SHARDS;
+    fclose(config);
+    return ok;
+}
+
+// Partes de uma frota ja particionada voltam para veiculos.dat (sem os
+// removidos) antes de uma nova criacao, que sempre parte de veiculos.dat.
+// Os arquivos dos shards antigos sao apagados.
+bool shard_juntar_dados(ShardedBTree *antiga, const char *data_file) {
+    char temporario[300];
+    sprintf(temporario, "%s.tmp", data_file);
+    FILE *destino = fopen(temporario, "wb");
+    if (!destino) return false;
+    
+    Veiculo *bloco = (Veiculo*)malloc(BLOCO_PARTICAO * sizeof(Veiculo));
+    bool compacto = false;
+    int total = 0;
+    
+    for (int s = 0; s < antiga->num_shards; s++) {
+        char nome[256];
+        shard_nome_arquivo(nome, "veiculos", "dat", s, antiga->num_shards);
+        FILE *origem = fopen(nome, "rb");
+        if (!origem) continue;
+        
+        CompactHeader *dicionario = compact_read_header(origem);
+        int num_registros = data_num_registros_file(origem, dicionario);
+        compacto = compacto || dicionario != NULL;
+        
+        for (int primeiro = 0; primeiro < num_registros; primeiro += BLOCO_PARTICAO) {
+            int lidos = data_read_block_file(origem, dicionario, primeiro, BLOCO_PARTICAO, bloco);
+            for (int i = 0; i < lidos; i++) {
+                if (strstr(bloco[i].status, "REMOVIDO") != NULL) continue;
+                fwrite(&bloco[i], sizeof(Veiculo), 1, destino);
+                total++;
+            }
+        }
+        fclose(origem);
+        free(dicionario);
+    }
+    free(bloco);
+    fclose(destino);
+    
+    if (rename(temporario, data_file) != 0) {
+        remove(temporario);
+        return false;
+    }
+    if (compacto) {
+        data_convert_file(data_file, FORMATO_COMPACTO, false);
+    }
+    
+    const char *arquivos[][2] = {
+        { "veiculos", "dat" }, { "veiculos", "dat.pool" }, { "veiculos", "txt" },
+        { "btree_M", "idx" }, { "btree_M", "idx.buf" }
+    };
+    for (int s = 0; s < antiga->num_shards; s++) {
+        for (int a = 0; a < 5; a++) {
+            char nome[256];
+            shard_nome_arquivo(nome, arquivos[a][0], arquivos[a][1], s, antiga->num_shards);
+            remove(nome);
+        }
+    }
+    remove(antiga->config_filename);
+    printf("%d shards reunidos em %s: %d registros\n", antiga->num_shards, data_file, total);
+    return true;
+}
+
+ShardedBTree* sharded_open(int num_shards, int modo, bool criar) {
+    ShardedBTree *frota = (ShardedBTree*)calloc(1, sizeof(ShardedBTree));
+    strcpy(frota->config_filename, "btree_M.part");
+    
+    if (criar) {
+        ShardedBTree antiga;
+        memset(&antiga, 0, sizeof(antiga));
+        if (sharded_ler_config(&antiga) && !shard_juntar_dados(&antiga, "veiculos.dat")) {
+            printf("Falha ao reunir os shards existentes!\n");
+            free(frota);
+            return NULL;
+        }
+    } else if (sharded_ler_config(frota)) {
+        // Com btree_M.part os dados vivem nos shards: o indice unico que
+        // sobrou do particionamento esta desatualizado e nunca e aberto
+        if (num_shards <= 1) {
+            printf("Indice particionado encontrado: abrindo os %d shards.\n", frota->num_shards);
+        }
+        num_shards = frota->num_shards;
+        modo = frota->modo;
+    } else if (num_shards > 1) {
+        printf("Configuracao de particoes nao encontrada!\n");
+        free(frota);
+        return NULL;
+    }
+    
+    if (num_shards < 1) num_shards = 1;
+    if (num_shards > MAX_SHARDS) num_shards = MAX_SHARDS;
+    frota->num_shards = num_shards;
+    frota->modo = modo;
+    
+    if (criar && num_shards > 1) {
+        if (!shard_particionar_dados(frota, "veiculos.dat")) {
+            free(frota);
+            return NULL;
+        }
+        
+        FILE *config = fopen(frota->config_filename, "wb");
+        if (config) {
+            fwrite(&frota->num_shards, sizeof(int), 1, config);
+            fwrite(&frota->modo, sizeof(int), 1, config);
+            fclose(config);
+        }
+    }
+    
+    sharded_executar(frota, shard_abrir_thread, criar, NULL, NULL);
+    
+    for (int s = 0; s < frota->num_shards; s++) {
+        if (frota->shards[s] == NULL) {
+            printf("Falha ao abrir shard %d!\n", s);
+            sharded_close(frota);
+            return NULL;
+        }
+    }
+    
+    if (frota->num_shards > 1) {
+        printf("Indice particionado: %d shards (%s)\n", frota->num_shards,
+               frota->modo == SHARD_POR_HASH ? "hash" : "prefixo");
+    }
+    
+    const char *trace_file = getenv("LOCADORA_TRACE");
+    if (trace_file != NULL && trace_file[0] != '\0') {
+        frota->trace = trace_open(trace_file, frota);
+    }
+    return frota;
+}
+
+BTree* sharded_route(ShardedBTree *frota, char *placa) {
+    normalizar_placa(placa);
+    return frota->shards[shard_de_placa(frota, placa)];
+}
+
+// Placa ja indexada e rejeitada aqui, antes de gravar o registro, para os
+// dois motores de insercao
+bool sharded_insert(ShardedBTree *frota, Veiculo *veiculo) {
+    double inicio = agora_segundos();
+    BTree *tree = sharded_route(frota, veiculo->placa);
+    pthread_mutex_lock(&tree->trava);
+    int rrn = -1;
+    if (btree_search_internal(tree, tree->root_rrn, veiculo->placa) == -1) {
+        rrn = data_insert_veiculo(tree, veiculo);
+        if (rrn != -1) {
+            btree_insert(tree, veiculo->placa, rrn);
+        }
+    }
+    pthread_mutex_unlock(&tree->trava);
+    trace_record(frota->trace, OP_INSERIR, inicio, veiculo, sizeof(Veiculo));
+    return rrn != -1;
+}
+
+void sharded_search(ShardedBTree *frota, const char *placa) {
+    char placa_busca[100];
+    strncpy(placa_busca, placa, sizeof(placa_busca) - 1);
+    placa_busca[sizeof(placa_busca) - 1] = '\0';
+    double inicio = agora_segundos();
+    BTree *tree = sharded_route(frota, placa_busca);
+    pthread_mutex_lock(&tree->trava);
+    btree_search(tree, placa_busca);
+    pthread_mutex_unlock(&tree->trava);
+    trace_record(frota->trace, OP_BUSCAR, inicio, placa_busca, TAMANHO_PLACA);
+}
+
+bool sharded_remove(ShardedBTree *frota, const char *placa) {
+    char placa_busca[100];
+    strncpy(placa_busca, placa, sizeof(placa_busca) - 1);
+    placa_busca[sizeof(placa_busca) - 1] = '\0';
+    double inicio = agora_segundos();
+    BTree *tree = sharded_route(frota, placa_busca);
+    pthread_mutex_lock(&tree->trava);
+    bool removido = btree_remove(tree, placa_busca);
+    pthread_mutex_unlock(&tree->trava);
+    trace_record_marcado(frota->trace, OP_REMOVER, TRACE_COM_TEXTO, inicio, placa_busca, TAMANHO_PLACA);
+    return removido;
+}
+
+void text_rebuild_shard(BTree *tree, void *argumento) {
+    (void)argumento;
+    text_rebuild_file(tree);
+}
+
+void sharded_rebuild_text(ShardedBTree *frota) {
+    double inicio = agora_segundos();
+    sharded_fan_out(frota, text_rebuild_shard, NULL);
+    trace_record(frota->trace, OP_RECONSTRUIR, inicio, NULL, 0);
+}
+
+typedef struct ExportPedido {
+    int formato;
+    bool ordem_indice;
+} ExportPedido;
+
+void export_shard(BTree *tree, void *argumento) {
+    ExportPedido *pedido = (ExportPedido*)argumento;
+    const char *extensoes[] = { "txt", "csv", "jsonl" };
+    
+    // veiculos_s3.dat -> exportacao_s3.csv
+    char export_file[300];
+    const char *sufixo = strstr(tree->data_filename, "veiculos");
+    sufixo = sufixo != NULL ? sufixo + strlen("veiculos") : "";
+    sprintf(export_file, "exportacao%.*s.%s", (int)strcspn(sufixo, "."), sufixo, extensoes[pedido->formato]);
+    
+    FILE *saida = fopen(export_file, "wb");
+    if (!saida) return;
+    
+    long exportados = export_tree(tree, saida, pedido->formato, pedido->ordem_indice);
+    fclose(saida);
+    printf("%s: %ld veiculos\n", export_file, exportados);
+}
+
+// Exporta todos os shards ao mesmo tempo, um arquivo por shard
+void sharded_export(ShardedBTree *frota, int formato, bool ordem_indice) {
+    ExportPedido pedido;
+    pedido.formato = formato;
+    pedido.ordem_indice = ordem_indice;
+    
+    double inicio = agora_segundos();
+    sharded_fan_out(frota, export_shard, &pedido);
+    printf("Exportacao concluida em %.3f s\n", agora_segundos() - inicio);
+}
+
+void sharded_print(ShardedBTree *frota) {
+    for (int s = 0; s < frota->num_shards; s++) {
+        if (frota->num_shards > 1) printf("\n##### Shard %d #####\n", s);
+        pthread_mutex_lock(&frota->shards[s]->trava);
+        btree_print(frota->shards[s]);
+        pthread_mutex_unlock(&frota->shards[s]->trava);
+    }
+}
+
+void* sharded_backup_thread(void *arg) {
+    ShardedBTree *frota = (ShardedBTree*)arg;
+    
+    for (int s = 0; s < frota->num_shards; s++) {
+        BTree *tree = frota->shards[s];
+        char backup_file[300];
+        sprintf(backup_file, "%s.bak", tree->data_filename);
+        snapshot_backup(tree, backup_file);
+    }
+    return NULL;
+}
+
+// Backup a quente: roda em segundo plano enquanto o menu continua aceitando escritas
+bool sharded_backup_start(ShardedBTree *frota) {
+    if (frota->backup_ativo) {
+        pthread_join(frota->backup_thread, NULL);
+        frota->backup_ativo = false;
+    }
+    if (pthread_create(&frota->backup_thread, NULL, sharded_backup_thread, frota) != 0) {
+        return false;
+    }
+    frota->backup_ativo = true;
+    return true;
+}
+
+void sharded_close(ShardedBTree *frota) {
+    if (frota) {
+        if (frota->backup_ativo) {
+            pthread_join(frota->backup_thread, NULL);
+        }
+        for (int s = 0; s < frota->num_shards; s++) {
+            btree_close(frota->shards[s]);
+        }
+        trace_close(frota->trace);
+        free(frota);
+    }
+}
+
+typedef struct ConversaoPedido {
+    int formato;
+    bool expurgar;
+    bool ok[MAX_SHARDS];
+} ConversaoPedido;
+
+void* shard_converter_thread(void *arg) {
+    ShardTarefa *tarefa = (ShardTarefa*)arg;
+    ConversaoPedido *pedido = (ConversaoPedido*)tarefa->argumento;
+    int num_shards = tarefa->frota->num_shards;
+    char idx[256], dat[256], txt[256];
+    shard_nome_arquivo(idx, "btree_M", "idx", tarefa->shard, num_shards);
+    shard_nome_arquivo(dat, "veiculos", "dat", tarefa->shard, num_shards);
+    shard_nome_arquivo(txt, "veiculos", "txt", tarefa->shard, num_shards);
+    pedido->ok[tarefa->shard] = data_convert_file(dat, pedido->formato, pedido->expurgar);
+    
+    // O expurgo muda os RRNs: indice, texto e pool do shard sao refeitos
+    if (pedido->ok[tarefa->shard] && pedido->expurgar) {
+        BTree *tree = btree_create(idx, dat, txt);
+        pedido->ok[tarefa->shard] = tree != NULL;
+        if (tree) btree_close(tree);
+    }
+    return NULL;
+}
+
+// Converte os arquivos de dados de todos os shards ao mesmo tempo (com os
+// indices fechados: os RRNs nao mudam, so a codificacao dos registros)
+bool sharded_convert(int formato) {
+    ShardedBTree frota;
+    memset(&frota, 0, sizeof(frota));
+    if (!sharded_ler_config(&frota)) {
+        printf("Configuracao de particoes nao encontrada!\n");
+        return false;
+    }
+    
+    ConversaoPedido pedido;
+    memset(&pedido, 0, sizeof(pedido));
+    pedido.formato = formato;
+    sharded_executar(&frota, shard_converter_thread, false, NULL, &pedido);
+    
+    bool ok = true;
+    for (int s = 0; s < frota.num_shards; s++) {
+        ok = ok && pedido.ok[s];
+    }
+    return ok;
+}
+
+// Expurga os registros removidos de todos os shards ao mesmo tempo (ou do
+// veiculos.dat unico) e refaz o indice de cada um. Roda com os indices fechados.
+bool sharded_purge() {
+    ShardedBTree frota;
+    memset(&frota, 0, sizeof(frota));
+    if (!sharded_ler_config(&frota)) {
+        frota.num_shards = 1;
+    }
+    
+    ConversaoPedido pedido;
+    memset(&pedido, 0, sizeof(pedido));
+    pedido.formato = FORMATO_ATUAL;
+    pedido.expurgar = true;
+    sharded_executar(&frota, shard_converter_thread, false, NULL, &pedido);
+    
+    bool ok = true;
+    for (int s = 0; s < frota.num_shards; s++) {
+        ok = ok && pedido.ok[s];
+    }
+    return ok;
+}
+
+void buffer_mode_shard(BTree *tree, void *argumento) {
+    pthread_mutex_lock(&tree->trava);
+    btree_set_buffered(tree, *(bool*)argumento);
+    pthread_mutex_unlock(&tree->trava);
+}
+
+void sharded_set_buffered(ShardedBTree *frota, bool ativar) {
+    sharded_fan_out(frota, buffer_mode_shard, &ativar);
+}
+
+// Protocolo binario (servidor local e gerador de carga)
+int frota_buscar(ShardedBTree *frota, const char *placa, Veiculo *veiculo) {
+    double inicio = agora_segundos();
+    BTree *tree = frota->shards[shard_de_placa(frota, placa)];
+    int status = RESP_NAO_ENCONTRADO;
+    
+    pthread_mutex_lock(&tree->trava);
+    int rrn = btree_search_internal(tree, tree->root_rrn, placa);
+    if (rrn != -1 && data_read_veiculo(tree, rrn, veiculo) &&
+        strcmp(veiculo->status, "*REMOVIDO*") != 0) {
+        status = RESP_OK;
+    }
+    pthread_mutex_unlock(&tree->trava);
+    trace_record(frota->trace, OP_BUSCAR, inicio, placa, TAMANHO_PLACA);
+    return status;
+}
+
+int frota_atualizar(ShardedBTree *frota, Veiculo *veiculo) {
+    double inicio = agora_segundos();
+    BTree *tree = sharded_route(frota, veiculo->placa);
+    int status = RESP_NAO_ENCONTRADO;
+    
+    pthread_mutex_lock(&tree->trava);
+    int rrn = btree_search_internal(tree, tree->root_rrn, veiculo->placa);
+    if (rrn != -1) {
+        status = data_update_veiculo(tree, rrn, veiculo) ? RESP_OK : RESP_ERRO;
+    }
+    pthread_mutex_unlock(&tree->trava);
+    trace_record(frota->trace, OP_ATUALIZAR, inicio, veiculo, sizeof(Veiculo));
+    return status;
+}
+
+int frota_remover(ShardedBTree *frota, char *placa) {
+    double inicio = agora_segundos();
+    BTree *tree = sharded_route(frota, placa);
+    
+    pthread_mutex_lock(&tree->trava);
+    int resultado = btree_remove_key(tree, placa);
+    pthread_mutex_unlock(&tree->trava);
+    trace_record(frota->trace, OP_REMOVER, inicio, placa, TAMANHO_PLACA);
+    
+    if (resultado == REMOCAO_OK) return RESP_OK;
+    if (resultado == REMOCAO_FALHOU) return RESP_ERRO;
+    return RESP_NAO_ENCONTRADO;
+}
+
+// Qualquer shard serve: o primeiro com veiculo disponivel na categoria atende
+int frota_retirar(ShardedBTree *frota, const char *categoria, Veiculo *veiculo) {
+    double inicio = agora_segundos();
+    int status = RESP_NAO_ENCONTRADO;
+    
+    for (int s = 0; s < frota->num_shards && status != RESP_OK; s++) {
+        if (btree_retirar(frota->shards[s], categoria, veiculo) != -1) {
+            status = RESP_OK;
+        }
+    }
+    trace_record(frota->trace, OP_RETIRAR, inicio, categoria, TAMANHO_CATEGORIA);
+    return status;
+}
+
+int frota_devolver(ShardedBTree *frota, char *placa, Veiculo *veiculo) {
+    double inicio = agora_segundos();
+    int status = btree_devolver(sharded_route(frota, placa), placa, veiculo);
+    trace_record(frota->trace, OP_DEVOLVER, inicio, placa, TAMANHO_PLACA);
+    return status;
+}
+
+typedef struct VarreduraContexto {
+    Snapshot *snap;
+    Veiculo *veiculos;
+    int quantidade;
+    int limite;
+} VarreduraContexto;
+
+bool frota_varrer_visitar(const char *placa, int rrn, void *contexto) {
+    VarreduraContexto *varredura = (VarreduraContexto*)contexto;
+    (void)placa;
+    
+    Veiculo *destino = &varredura->veiculos[varredura->quantidade];
+    if (snapshot_read_veiculo(varredura->snap, rrn, destino) &&
+        strcmp(destino->status, "*REMOVIDO*") != 0) {
+        varredura->quantidade++;
+    }
+    return varredura->quantidade < varredura->limite;
+}
+
+int comparar_veiculos_placa(const void *a, const void *b) {
+    return strncmp(((const Veiculo*)a)->placa, ((const Veiculo*)b)->placa, TAMANHO_PLACA);
+}
+
+// Os shards por hash nao sao ordenados entre si: cada um contribui com ate
+// limite registros e o resultado e intercalado por placa
+int frota_varrer(ShardedBTree *frota, const char *inicio, int limite, Veiculo *resultado) {
+    double comeco = agora_segundos();
+    Veiculo *candidatos = (Veiculo*)malloc((size_t)limite * frota->num_shards * sizeof(Veiculo));
+    int total = 0;
+    
+    for (int s = 0; s < frota->num_shards; s++) {
+        VarreduraContexto varredura;
+        varredura.snap = snapshot_open(frota->shards[s]);
+        varredura.veiculos = candidatos + total;
+        varredura.quantidade = 0;
+        varredura.limite = limite;
+        
+        snapshot_scan(varredura.snap, inicio, frota_varrer_visitar, &varredura);
+        snapshot_close(varredura.snap);
+        total += varredura.quantidade;
+    }
+    
+    qsort(candidatos, total, sizeof(Veiculo), comparar_veiculos_placa);
+    if (total > limite) total = limite;
+    memcpy(resultado, candidatos, total * sizeof(Veiculo));
+    free(candidatos);
+    
+    if (frota->trace != NULL) {
+        char argumento[TAMANHO_PLACA + sizeof(uint16_t)];
+        uint16_t limite_gravado = limite;
+        memset(argumento, 0, sizeof(argumento));
+        strncpy(argumento, inicio, TAMANHO_PLACA - 1);
+        memcpy(argumento + TAMANHO_PLACA, &limite_gravado, sizeof(limite_gravado));
+        trace_record(frota->trace, OP_VARRER, comeco, argumento, sizeof(argumento));
+    }
+    return total;
+}
+
+bool escrever_tudo(int fd, const void *dados, size_t tamanho) {
+    const char *p = (const char*)dados;
+    while (tamanho > 0) {
+        ssize_t n = write(fd, p, tamanho);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        tamanho -= n;
+    }
+    return true;
+}
+
+bool ler_tudo(int fd, void *dados, size_t tamanho) {
+    char *p = (char*)dados;
+    while (tamanho > 0) {
+        ssize_t n = read(fd, p, tamanho);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        tamanho -= n;
+    }
+    return true;
+}
+
+int socket_conectar(const char *caminho) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    
+    struct sockaddr_un endereco;
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    strncpy(endereco.sun_path, caminho, sizeof(endereco.sun_path) - 1);
+    
+    if (connect(fd, (struct sockaddr*)&endereco, sizeof(endereco)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+#ifdef __linux__
+// Servidor: epoll sobre um socket Unix; cada volta do laco junta as
+// requisicoes completas de todas as conexoes e executa em lote
+typedef struct Conexao {
+    int fd;
+    char *entrada;
+    size_t entrada_tamanho;
+    size_t entrada_capacidade;
+    char *saida;
+    size_t saida_tamanho;
+    size_t saida_capacidade;
+    size_t saida_enviado;
+    bool esperando_escrita;
+    bool fechar;
+} Conexao;
+
+typedef struct Pendente {
+    Conexao *conexao;
+    MensagemCabecalho cabecalho;
+    char payload[sizeof(Veiculo)];
+    int shard;
+    int ordem;
+} Pendente;
+
+static volatile sig_atomic_t servidor_rodando = 1;
+
+void servidor_parar(int sinal) {
+    (void)sinal;
+    servidor_rodando = 0;
+}
+
+void conexao_reservar(char **buffer, size_t *capacidade, size_t necessario) {
+    if (necessario <= *capacidade) return;
+    size_t nova = *capacidade > 0 ? *capacidade : 4096;
+    while (nova < necessario) nova *= 2;
+    *buffer = (char*)realloc(*buffer, nova);
+    *capacidade = nova;
+}
+
+void conexao_responder(Conexao *conexao, uint32_t id, uint8_t op, uint8_t status, const void *payload, uint16_t tamanho) {
+    MensagemCabecalho resposta;
+    resposta.id = id;
+    resposta.op = op;
+    resposta.status = status;
+    resposta.tamanho = tamanho;
+    
+    conexao_reservar(&conexao->saida, &conexao->saida_capacidade,
+                     conexao->saida_tamanho + sizeof(resposta) + tamanho);
+    memcpy(conexao->saida + conexao->saida_tamanho, &resposta, sizeof(resposta));
+    conexao->saida_tamanho += sizeof(resposta);
+    if (tamanho > 0) {
+        memcpy(conexao->saida + conexao->saida_tamanho, payload, tamanho);
+        conexao->saida_tamanho += tamanho;
+    }
+}
+
+void conexao_enviar(int epoll_fd, Conexao *conexao) {
+    while (conexao->saida_enviado < conexao->saida_tamanho) {
+        ssize_t n = write(conexao->fd, conexao->saida + conexao->saida_enviado,
+                          conexao->saida_tamanho - conexao->saida_enviado);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            conexao->fechar = true;
+            return;
+        }
+        conexao->saida_enviado += n;
+    }
+    
+    bool pendente = conexao->saida_enviado < conexao->saida_tamanho;
+    if (!pendente) {
+        conexao->saida_tamanho = 0;
+        conexao->saida_enviado = 0;
+    }
+    
+    if (pendente != conexao->esperando_escrita) {
+        struct epoll_event evento;
+        evento.events = EPOLLIN | (pendente ? EPOLLOUT : 0);
+        evento.data.ptr = conexao;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conexao->fd, &evento);
+        conexao->esperando_escrita = pendente;
+    }
+}
+
+void conexao_fechar(int epoll_fd, Conexao *conexao) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conexao->fd, NULL);
+    close(conexao->fd);
+    free(conexao->entrada);
+    free(conexao->saida);
+    free(conexao);
+}
+
+bool requisicao_eh_leitura(const Pendente *p) {
+    return p->cabecalho.op == OP_BUSCAR || p->cabecalho.op == OP_VARRER;
+}
+
+int comparar_pendentes(const void *a, const void *b) {
+    const Pendente *pa = (const Pendente*)a;
+    const Pendente *pb = (const Pendente*)b;
+    if (pa->shard != pb->shard) return pa->shard - pb->shard;
+    int cmp = strncmp(pa->payload, pb->payload, TAMANHO_PLACA);
+    if (cmp != 0) return cmp;
+    return pa->ordem - pb->ordem;
+}
+
+void servidor_executar(ShardedBTree *frota, Pendente *p, Veiculo *varredura) {
+    MensagemCabecalho *req = &p->cabecalho;
+    Conexao *conexao = p->conexao;
+    Veiculo veiculo;
+    int status;
+    
+    switch (req->op) {
+        case OP_BUSCAR:
+            status = frota_buscar(frota, p->payload, &veiculo);
+            conexao_responder(conexao, req->id, req->op, status, &veiculo,
+                              status == RESP_OK ? sizeof(Veiculo) : 0);
+            break;
+            
+        case OP_INSERIR:
+            memcpy(&veiculo, p->payload, sizeof(Veiculo));
+            status = sharded_insert(frota, &veiculo) ? RESP_OK : RESP_ERRO;
+            conexao_responder(conexao, req->id, req->op, status, NULL, 0);
+            break;
+            
+        case OP_ATUALIZAR:
+            memcpy(&veiculo, p->payload, sizeof(Veiculo));
+            status = frota_atualizar(frota, &veiculo);
+            conexao_responder(conexao, req->id, req->op, status, NULL, 0);
+            break;
+            
+        case OP_REMOVER:
+            status = frota_remover(frota, p->payload);
+            conexao_responder(conexao, req->id, req->op, status, NULL, 0);
+            break;
+            
+        case OP_VARRER: {
+            uint16_t limite;
+            memcpy(&limite, p->payload + TAMANHO_PLACA, sizeof(limite));
+            if (limite == 0 || limite > SCAN_MAX_REGISTROS) limite = SCAN_MAX_REGISTROS;
+            int quantidade = frota_varrer(frota, p->payload, limite, varredura);
+            conexao_responder(conexao, req->id, req->op, RESP_OK, varredura,
+                              quantidade * sizeof(Veiculo));
+            break;
+        }
+            
+        case OP_RETIRAR:
+            status = frota_retirar(frota, p->payload, &veiculo);
+            conexao_responder(conexao, req->id, req->op, status, &veiculo,
+                              status == RESP_OK ? sizeof(Veiculo) : 0);
+            break;
+            
+        case OP_DEVOLVER:
+            status = frota_devolver(frota, p->payload, &veiculo);
+            conexao_responder(conexao, req->id, req->op, status, NULL, 0);
+            break;
+            
+        default:
+            conexao_responder(conexao, req->id, req->op, RESP_ERRO, NULL, 0);
+    }
+}
+
+// Extrai as requisicoes completas do buffer de entrada da conexao
+void servidor_extrair(ShardedBTree *frota, Conexao *conexao, Pendente **pendentes, int *num, int *capacidade) {
+    size_t pos = 0;
+    
+    while (conexao->entrada_tamanho - pos >= sizeof(MensagemCabecalho)) {
+        MensagemCabecalho cabecalho;
+        memcpy(&cabecalho, conexao->entrada + pos, sizeof(cabecalho));
+        if (conexao->entrada_tamanho - pos < sizeof(cabecalho) + cabecalho.tamanho) break;
+        
+        if (*num == *capacidade) {
+            *capacidade *= 2;
+            *pendentes = (Pendente*)realloc(*pendentes, *capacidade * sizeof(Pendente));
+        }
+        Pendente *p = &(*pendentes)[*num];
+        memset(p, 0, sizeof(Pendente));
+        p->conexao = conexao;
+        p->cabecalho = cabecalho;
+        p->ordem = *num;
+        
+        if (cabecalho.tamanho > sizeof(p->payload)) {
+            p->cabecalho.op = 0;
+        } else {
+            memcpy(p->payload, conexao->entrada + pos + sizeof(cabecalho), cabecalho.tamanho);
+        }
+        
+        if (p->cabecalho.op == OP_INSERIR || p->cabecalho.op == OP_ATUALIZAR) {
+            // Strings vindas do cliente podem chegar sem terminador
+            Veiculo veiculo;
+            memcpy(&veiculo, p->payload, sizeof(Veiculo));
+            veiculo.placa[TAMANHO_PLACA - 1] = '\0';
+            veiculo.modelo[TAMANHO_MODELO - 1] = '\0';
+            veiculo.marca[TAMANHO_MARCA - 1] = '\0';
+            veiculo.categoria[TAMANHO_CATEGORIA - 1] = '\0';
+            veiculo.status[TAMANHO_STATUS - 1] = '\0';
+            memcpy(p->payload, &veiculo, sizeof(Veiculo));
+        } else if (p->cabecalho.op == OP_RETIRAR) {
+            p->payload[TAMANHO_CATEGORIA - 1] = '\0';
+        } else if (p->cabecalho.op != 0) {
+            p->payload[TAMANHO_PLACA - 1] = '\0';
+            normalizar_placa(p->payload);
+        }
+        p->shard = shard_de_placa(frota, p->payload);
+        
+        (*num)++;
+        pos += sizeof(cabecalho) + cabecalho.tamanho;
+    }
+    
+    memmove(conexao->entrada, conexao->entrada + pos, conexao->entrada_tamanho - pos);
+    conexao->entrada_tamanho -= pos;
+}
+
+int servidor_iniciar(ShardedBTree *frota, const char *caminho) {
+    int escuta = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (escuta < 0) {
+        printf("Falha ao criar socket!\n");
+        return 1;
+    }
+    
+    struct sockaddr_un endereco;
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    strncpy(endereco.sun_path, caminho, sizeof(endereco.sun_path) - 1);
+    unlink(caminho);
+    
+    if (bind(escuta, (struct sockaddr*)&endereco, sizeof(endereco)) < 0 || listen(escuta, 128) < 0) {
+        printf("Falha ao escutar em %s!\n", caminho);
+        close(escuta);
+        return 1;
+    }
+    
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event evento;
+    evento.events = EPOLLIN;
+    evento.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, escuta, &evento);
+    
+    signal(SIGINT, servidor_parar);
+    signal(SIGTERM, servidor_parar);
+    signal(SIGPIPE, SIG_IGN);
+    
+    int capacidade = 256;
+    Pendente *pendentes = (Pendente*)malloc(capacidade * sizeof(Pendente));
+    Veiculo *varredura = (Veiculo*)malloc(SCAN_MAX_REGISTROS * sizeof(Veiculo));
+    Conexao *ativas[SERVIDOR_MAX_EVENTOS];
+    struct epoll_event eventos[SERVIDOR_MAX_EVENTOS];
+    long atendidas = 0;
+    
+    printf("Servidor escutando em %s (Ctrl+C para encerrar)\n", caminho);
+    
+    while (servidor_rodando) {
+        int n = epoll_wait(epoll_fd, eventos, SERVIDOR_MAX_EVENTOS, 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        
+        int num_pendentes = 0;
+        int num_ativas = 0;
+        
+        for (int i = 0; i < n; i++) {
+            Conexao *conexao = (Conexao*)eventos[i].data.ptr;
+            
+            if (conexao == NULL) {
+                int fd;
+                while ((fd = accept(escuta, NULL, NULL)) >= 0) {
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    Conexao *nova = (Conexao*)calloc(1, sizeof(Conexao));
+                    nova->fd = fd;
+                    struct epoll_event ev;
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = nova;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+                }
+                continue;
+            }
+            
+            if (eventos[i].events & EPOLLOUT) {
+                conexao_enviar(epoll_fd, conexao);
+            }
+            
+            if (eventos[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                for (;;) {
+                    conexao_reservar(&conexao->entrada, &conexao->entrada_capacidade,
+                                     conexao->entrada_tamanho + 4096);
+                    ssize_t lidos = read(conexao->fd, conexao->entrada + conexao->entrada_tamanho,
+                                         conexao->entrada_capacidade - conexao->entrada_tamanho);
+                    if (lidos > 0) {
+                        conexao->entrada_tamanho += lidos;
+                        continue;
+                    }
+                    if (lidos < 0 && errno == EINTR) continue;
+                    if (lidos == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                        conexao->fechar = true;
+                    }
+                    break;
+                }
+                servidor_extrair(frota, conexao, &pendentes, &num_pendentes, &capacidade);
+            }
+            
+            ativas[num_ativas++] = conexao;
+        }
+        
+        // Leituras consecutivas nao conflitam: ordenadas por shard e placa,
+        // aproveitam as paginas ja no cache. Escritas mantem a ordem de chegada.
+        int i = 0;
+        while (i < num_pendentes) {
+            if (!requisicao_eh_leitura(&pendentes[i])) {
+                servidor_executar(frota, &pendentes[i], varredura);
+                i++;
+                continue;
+            }
+            
+            int fim = i;
+            while (fim < num_pendentes && requisicao_eh_leitura(&pendentes[fim])) fim++;
+            qsort(pendentes + i, fim - i, sizeof(Pendente), comparar_pendentes);
+            
+            int shard_travado = -1;
+            for (int j = i; j < fim; j++) {
+                if (pendentes[j].shard != shard_travado) {
+                    if (shard_travado != -1) pthread_mutex_unlock(&frota->shards[shard_travado]->trava);
+                    shard_travado = pendentes[j].shard;
+                    pthread_mutex_lock(&frota->shards[shard_travado]->trava);
+                }
+                servidor_executar(frota, &pendentes[j], varredura);
+            }
+            if (shard_travado != -1) pthread_mutex_unlock(&frota->shards[shard_travado]->trava);
+            i = fim;
+        }
+        atendidas += num_pendentes;
+        
+        for (int j = 0; j < num_ativas; j++) {
+            Conexao *conexao = ativas[j];
+            if (conexao == NULL) continue;
+            for (int k = j + 1; k < num_ativas; k++) {
+                if (ativas[k] == conexao) ativas[k] = NULL;
+            }
+            
+            conexao_enviar(epoll_fd, conexao);
+            if (conexao->fechar) {
+                conexao_fechar(epoll_fd, conexao);
+            }
+        }
+    }
+    
+    printf("\nServidor encerrado (%ld requisicoes atendidas)\n", atendidas);
+    free(pendentes);
+    free(varredura);
+    close(epoll_fd);
+    close(escuta);
+    unlink(caminho);
+    return 0;
+}
+#else
+int servidor_iniciar(ShardedBTree *frota, const char *caminho) {
+    (void)frota;
+    (void)caminho;
+    printf("Modo servidor disponivel apenas no Linux (epoll)\n");
+    return 1;
+}
+#endif
+
+// Gerador de carga: uma thread por conexao, cada uma enviando lotes de
+// 'pipeline' requisicoes por ida e volta
+typedef struct CargaThread {
+    const char *caminho;
+    int id;
+    int requisicoes;
+    int pipeline;
+    int percentual_escrita;
+    char (*placas)[TAMANHO_PLACA];
+    int num_placas;
+    Veiculo *proprios;
+    int num_proprios;
+    int criados;
+    double *latencias;
+    int concluidas;
+    int erros;
+} CargaThread;
+
+// Placas do gerador: '9' + conexao (2 digitos, ate 64) + sequencia (4
+// digitos). Comecam com digito, entao nao colidem com placas da frota nem
+// com as de outra conexao.
+void carga_novo_veiculo(CargaThread *carga, Veiculo *veiculo) {
+    memset(veiculo, 0, sizeof(Veiculo));
+    snprintf(veiculo->placa, TAMANHO_PLACA, "9%02u%04u", (unsigned)carga->id % 100u,
+             (unsigned)carga->criados++ % CARGA_MAX_PROPRIOS);
+    strcpy(veiculo->modelo, "Carga");
+    strcpy(veiculo->marca, "Gerador");
+    strcpy(veiculo->categoria, "Teste");
+    strcpy(veiculo->status, STATUS_DISPONIVEL);
+    veiculo->ano = 2024;
+}
+
+void* carga_thread(void *arg) {
+    CargaThread *carga = (CargaThread*)arg;
+    int fd = socket_conectar(carga->caminho);
+    if (fd < 0) {
+        carga->erros = carga->requisicoes;
+        return NULL;
+    }
+    
+    size_t tamanho_lote = carga->pipeline * (sizeof(MensagemCabecalho) + sizeof(Veiculo));
+    char *lote = (char*)malloc(tamanho_lote);
+    Veiculo *resposta = (Veiculo*)malloc(SCAN_MAX_REGISTROS * sizeof(Veiculo));
+    unsigned int semente = 12345u + carga->id;
+    uint32_t proximo_id = 0;
+    
+    while (carga->concluidas < carga->requisicoes) {
+        int quantidade = carga->requisicoes - carga->concluidas;
+        if (quantidade > carga->pipeline) quantidade = carga->pipeline;
+        
+        size_t usado = 0;
+        for (int i = 0; i < quantidade; i++) {
+            MensagemCabecalho req;
+            memset(&req, 0, sizeof(req));
+            req.id = proximo_id++;
+            
+            const char *placa = carga->num_placas > 0
+                ? carga->placas[rand_r(&semente) % carga->num_placas] : "AAA0000";
+            bool escrita = (int)(rand_r(&semente) % 100) < carga->percentual_escrita;
+            
+            // Escritas so tocam veiculos criados pelo proprio gerador
+            if (escrita) {
+                int sorteio = rand_r(&semente) % 3;
+                if (carga->num_proprios == 0 || (sorteio == 0 && carga->criados < CARGA_MAX_PROPRIOS)) {
+                    carga_novo_veiculo(carga, &carga->proprios[carga->num_proprios++]);
+                    req.op = OP_INSERIR;
+                    req.tamanho = sizeof(Veiculo);
+                    memcpy(lote + usado + sizeof(req), &carga->proprios[carga->num_proprios - 1], sizeof(Veiculo));
+                } else if (sorteio == 1) {
+                    Veiculo *veiculo = &carga->proprios[rand_r(&semente) % carga->num_proprios];
+                    veiculo->quilometragem += 1 + rand_r(&semente) % 500;
+                    strcpy(veiculo->status, strcmp(veiculo->status, STATUS_ALUGADO) == 0
+                                            ? STATUS_DISPONIVEL : STATUS_ALUGADO);
+                    req.op = OP_ATUALIZAR;
+                    req.tamanho = sizeof(Veiculo);
+                    memcpy(lote + usado + sizeof(req), veiculo, sizeof(Veiculo));
+                } else {
+                    int escolhido = rand_r(&semente) % carga->num_proprios;
+                    req.op = OP_REMOVER;
+                    req.tamanho = TAMANHO_PLACA;
+                    memcpy(lote + usado + sizeof(req), carga->proprios[escolhido].placa, TAMANHO_PLACA);
+                    carga->proprios[escolhido] = carga->proprios[--carga->num_proprios];
+                }
+                memcpy(lote + usado, &req, sizeof(req));
+            } else {
+                req.op = OP_BUSCAR;
+                req.tamanho = TAMANHO_PLACA;
+                memcpy(lote + usado, &req, sizeof(req));
+                memcpy(lote + usado + sizeof(req), placa, TAMANHO_PLACA);
+            }
+            usado += sizeof(req) + req.tamanho;
+        }
+        
+        double inicio = agora_segundos();
+        if (!escrever_tudo(fd, lote, usado)) break;
+        
+        for (int i = 0; i < quantidade; i++) {
+            MensagemCabecalho resp;
+            if (!ler_tudo(fd, &resp, sizeof(resp))) goto fim;
+            if (resp.tamanho > 0 && !ler_tudo(fd, resposta, resp.tamanho)) goto fim;
+            if (resp.status == RESP_ERRO) carga->erros++;
+            carga->latencias[carga->concluidas++] = agora_segundos() - inicio;
+        }
     }
-    printf("]\n");
     
-    if (!node->is_leaf) {
-        for (int i = 0; i <= node->num_keys; i++) {
-            btree_print_node(tree, node->children[i], level + 1);
+fim:
+    // Remove o que sobrou dos veiculos criados, fora das estatisticas
+    for (int i = 0; i < carga->num_proprios; i++) {
+        MensagemCabecalho req;
+        memset(&req, 0, sizeof(req));
+        req.op = OP_REMOVER;
+        req.tamanho = TAMANHO_PLACA;
+        memcpy(lote, &req, sizeof(req));
+        memcpy(lote + sizeof(req), carga->proprios[i].placa, TAMANHO_PLACA);
+        MensagemCabecalho resp;
+        if (!escrever_tudo(fd, lote, sizeof(req) + TAMANHO_PLACA) ||
+            !ler_tudo(fd, &resp, sizeof(resp)) ||
+            (resp.tamanho > 0 && !ler_tudo(fd, resposta, resp.tamanho))) {
+            break;
         }
     }
+    
+    free(lote);
+    free(resposta);
+    close(fd);
+    return NULL;
 }
 
-void btree_print(BTree *tree) {
-    if (tree->root_rrn == -1) {
-        printf("Arvore vazia!\n");
-        return;
+int comparar_double(const void *a, const void *b) {
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+double percentil(double *ordenados, int n, double p) {
+    if (n == 0) return 0;
+    int indice = (int)(p * (n - 1));
+    return ordenados[indice];
+}
+
+int carga_executar(const char *caminho, int requisicoes, int conexoes, int pipeline, int percentual_escrita) {
+    if (conexoes < 1) conexoes = 1;
+    if (conexoes > 64) conexoes = 64;
+    if (pipeline < 1) pipeline = 1;
+    
+    // Placas reais de veiculos.dat, para que as buscas encontrem registros
+    int num_placas = 0;
+    char (*placas)[TAMANHO_PLACA] = NULL;
+    FILE *dados = fopen("veiculos.dat", "rb");
+    if (dados) {
+        CompactHeader *dicionario = compact_read_header(dados);
+        int total = data_num_registros_file(dados, dicionario);
+        placas = malloc((total > 0 ? total : 1) * sizeof(*placas));
+        Veiculo *bloco = (Veiculo*)malloc(BLOCO_PARTICAO * sizeof(Veiculo));
+        for (int primeiro = 0; primeiro < total; primeiro += BLOCO_PARTICAO) {
+            int lidos = data_read_block_file(dados, dicionario, primeiro, BLOCO_PARTICAO, bloco);
+            for (int i = 0; i < lidos; i++) {
+                if (strncmp(bloco[i].status, "*REMOVIDO*", TAMANHO_STATUS) == 0) continue;
+                memcpy(placas[num_placas], bloco[i].placa, TAMANHO_PLACA);
+                placas[num_placas][TAMANHO_PLACA - 1] = '\0';
+                num_placas++;
+            }
+            if (lidos < BLOCO_PARTICAO) break;
+        }
+        free(bloco);
+        free(dicionario);
+        fclose(dados);
     }
     
-    printf("\n=== Estrutura da Arvore B ===\n");
-    btree_print_node(tree, tree->root_rrn, 0);
+    CargaThread cargas[64];
+    pthread_t threads[64];
     
-    printf("\n=== Cache (%d/%d) ===\n", tree->page_queue->size, P);
-    PageQueueNode *current = tree->page_queue->front;
-    int pos = 1;
-    while (current != NULL) {
-        printf("%d. RNN=%d %s\n", pos++, current->rrn, 
-               current->page->modified ? "[MOD]" : "");
-        current = current->next;
+    printf("Carga: %d requisicoes, %d conexoes, pipeline %d, %d%% escritas\n",
+           requisicoes, conexoes, pipeline, percentual_escrita);
+    
+    double inicio = agora_segundos();
+    for (int c = 0; c < conexoes; c++) {
+        cargas[c].caminho = caminho;
+        cargas[c].id = c;
+        cargas[c].requisicoes = requisicoes / conexoes + (c < requisicoes % conexoes ? 1 : 0);
+        cargas[c].pipeline = pipeline;
+        cargas[c].percentual_escrita = percentual_escrita;
+        cargas[c].placas = placas;
+        cargas[c].num_placas = num_placas;
+        cargas[c].latencias = (double*)malloc((cargas[c].requisicoes + 1) * sizeof(double));
+        cargas[c].proprios = (Veiculo*)malloc(CARGA_MAX_PROPRIOS * sizeof(Veiculo));
+        cargas[c].num_proprios = 0;
+        cargas[c].criados = 0;
+        cargas[c].concluidas = 0;
+        cargas[c].erros = 0;
+        pthread_create(&threads[c], NULL, carga_thread, &cargas[c]);
     }
-    printf("\n");
+    
+    int concluidas = 0;
+    int erros = 0;
+    for (int c = 0; c < conexoes; c++) {
+        pthread_join(threads[c], NULL);
+        concluidas += cargas[c].concluidas;
+        erros += cargas[c].erros;
+    }
+    double duracao = agora_segundos() - inicio;
+    
+    double *todas = (double*)malloc((concluidas + 1) * sizeof(double));
+    int n = 0;
+    for (int c = 0; c < conexoes; c++) {
+        memcpy(todas + n, cargas[c].latencias, cargas[c].concluidas * sizeof(double));
+        n += cargas[c].concluidas;
+        free(cargas[c].latencias);
+        free(cargas[c].proprios);
+    }
+    qsort(todas, n, sizeof(double), comparar_double);
+    
+    printf("Concluidas: %d (erros: %d) em %.3f s\n", concluidas, erros, duracao);
+    printf("Vazao: %.0f req/s\n", duracao > 0 ? concluidas / duracao : 0);
+    printf("Latencia (us): p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+           percentil(todas, n, 0.50) * 1e6, percentil(todas, n, 0.90) * 1e6,
+           percentil(todas, n, 0.99) * 1e6, percentil(todas, n, 0.999) * 1e6,
+           n > 0 ? todas[n - 1] * 1e6 : 0);
+    
+    free(todas);
+    free(placas);
+    return concluidas == requisicoes ? 0 : 1;
 }
 
-int data_insert_veiculo(BTree *tree, Veiculo *veiculo) {
-    fseek(tree->data_file, 0, SEEK_END);
-    long pos = ftell(tree->data_file);
-    int rrn = pos / sizeof(Veiculo);
+// Replay de trace: aplica as operacoes gravadas em uma copia de veiculos.dat
+// e mede latencia e I/O por tipo de operacao
+const char *NOMES_OPERACOES[NUM_OPS] = {
+    "?", "buscar", "inserir", "atualizar", "remover", "varrer", "reconstruir", "retirar", "devolver"
+};
+
+typedef struct ReplayEstatistica {
+    int quantidade;
+    int capacidade;
+    double *latencias;
+    double *gravadas;
+    long leituras_pagina;
+    long escritas_pagina;
+    long leituras_registro;
+    long escritas_registro;
+} ReplayEstatistica;
+
+void replay_aguardar(double instante) {
+    double restante = instante - agora_segundos();
+    if (restante <= 0) return;
     
-    fwrite(veiculo, sizeof(Veiculo), 1, tree->data_file);
-    fflush(tree->data_file);
+    struct timespec ts;
+    ts.tv_sec = (time_t)restante;
+    ts.tv_nsec = (long)((restante - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+void replay_salvar(ReplayEstatistica *estatisticas, const char *saida) {
+    FILE *arquivo = saida != NULL ? fopen(saida, "w") : NULL;
     
-    text_append_veiculo(tree, veiculo, rrn);
+    printf("\n%-12s %8s %10s %10s %10s %10s %9s %9s %9s %9s\n", "operacao", "qtd",
+           "p50(us)", "p90(us)", "p99(us)", "max(us)", "pag.lid", "pag.esc", "reg.lid", "reg.esc");
     
-    return rrn;
+    for (int op = 1; op < NUM_OPS; op++) {
+        ReplayEstatistica *e = &estatisticas[op];
+        if (e->quantidade == 0) continue;
+        
+        qsort(e->latencias, e->quantidade, sizeof(double), comparar_double);
+        double p50 = percentil(e->latencias, e->quantidade, 0.50) * 1e6;
+        double p90 = percentil(e->latencias, e->quantidade, 0.90) * 1e6;
+        double p99 = percentil(e->latencias, e->quantidade, 0.99) * 1e6;
+        double max = e->latencias[e->quantidade - 1] * 1e6;
+        double n = e->quantidade;
+        
+        printf("%-12s %8d %10.1f %10.1f %10.1f %10.1f %9.2f %9.2f %9.2f %9.2f\n",
+               NOMES_OPERACOES[op], e->quantidade, p50, p90, p99, max,
+               e->leituras_pagina / n, e->escritas_pagina / n,
+               e->leituras_registro / n, e->escritas_registro / n);
+        
+        if (arquivo) {
+            fprintf(arquivo, "%s %d %.3f %.3f %.3f %.3f %.4f %.4f %.4f %.4f\n",
+                    NOMES_OPERACOES[op], e->quantidade, p50, p90, p99, max,
+                    e->leituras_pagina / n, e->escritas_pagina / n,
+                    e->leituras_registro / n, e->escritas_registro / n);
+        }
+    }
+    
+    // Tempo medido na gravacao (duracao_us do trace) contra o do replay
+    printf("\n%-12s %12s %12s %12s %12s %12s %12s\n", "operacao", "grav.p50", "repl.p50",
+           "grav.p99", "repl.p99", "grav.tot(ms)", "repl.tot(ms)");
+    for (int op = 1; op < NUM_OPS; op++) {
+        ReplayEstatistica *e = &estatisticas[op];
+        if (e->quantidade == 0) continue;
+        
+        double total_gravado = 0, total_replay = 0;
+        for (int i = 0; i < e->quantidade; i++) {
+            total_gravado += e->gravadas[i];
+            total_replay += e->latencias[i];
+        }
+        qsort(e->gravadas, e->quantidade, sizeof(double), comparar_double);
+        printf("%-12s %12.1f %12.1f %12.1f %12.1f %12.2f %12.2f\n", NOMES_OPERACOES[op],
+               percentil(e->gravadas, e->quantidade, 0.50) * 1e6,
+               percentil(e->latencias, e->quantidade, 0.50) * 1e6,
+               percentil(e->gravadas, e->quantidade, 0.99) * 1e6,
+               percentil(e->latencias, e->quantidade, 0.99) * 1e6,
+               total_gravado * 1e3, total_replay * 1e3);
+    }
+    
+    if (arquivo) {
+        fclose(arquivo);
+        printf("\nResultado salvo em %s\n", saida);
+    }
 }
 
-void btree_load_from_data_file(BTree *tree) {
-    fseek(tree->data_file, 0, SEEK_END);
-    long file_size = ftell(tree->data_file);
+// Soma dos contadores de E/S de todos os shards: paginas lidas e escritas,
+// registros lidos e escritos
+void replay_contadores(ShardedBTree *frota, long contadores[4]) {
+    memset(contadores, 0, 4 * sizeof(long));
+    for (int s = 0; s < frota->num_shards; s++) {
+        contadores[0] += frota->shards[s]->leituras_pagina;
+        contadores[1] += frota->shards[s]->escritas_pagina;
+        contadores[2] += frota->shards[s]->leituras_registro;
+        contadores[3] += frota->shards[s]->escritas_registro;
+    }
+}
+
+int replay_executar(const char *trace_file, const char *saida, bool ritmo) {
+    FILE *trace = fopen(trace_file, "rb");
+    char magico[4];
+    if (!trace || fread(magico, 4, 1, trace) != 1 || memcmp(magico, TRACE_MAGICO, 4) != 0) {
+        printf("Trace invalido: %s\n", trace_file);
+        if (trace) fclose(trace);
+        return 1;
+    }
     
-    if (file_size == 0) {
-        printf("Arquivo de dados vazio!\n");
-        return;
+    ShardedBTree frota;
+    memset(&frota, 0, sizeof(frota));
+    if (fread(&frota.num_shards, sizeof(int), 1, trace) != 1 ||
+        fread(&frota.modo, sizeof(int), 1, trace) != 1 ||
+        frota.num_shards < 1 || frota.num_shards > MAX_SHARDS) {
+        printf("Trace invalido: %s\n", trace_file);
+        fclose(trace);
+        return 1;
     }
     
-    size_t tamanho_registro = sizeof(Veiculo);
-    int num_registros = file_size / tamanho_registro;
+    // O replay parte dos dados copiados no inicio da gravacao, com a mesma
+    // divisao em shards, sem tocar nos arquivos originais
+    for (int s = 0; s < frota.num_shards; s++) {
+        char copia[300], idx[256], dat[256], txt[256];
+        trace_nome_dados(copia, trace_file, s);
+        shard_nome_arquivo(idx, "replay_btree", "idx", s, frota.num_shards);
+        shard_nome_arquivo(dat, "replay_veiculos", "dat", s, frota.num_shards);
+        shard_nome_arquivo(txt, "replay_veiculos", "txt", s, frota.num_shards);
+        
+        if (!copiar_arquivo(copia, dat)) {
+            printf("Dados do trace nao encontrados: %s\n", copia);
+        } else {
+            frota.shards[s] = btree_create(idx, dat, txt);
+        }
+        if (!frota.shards[s]) {
+            for (int t = 0; t < s; t++) btree_close(frota.shards[t]);
+            fclose(trace);
+            return 1;
+        }
+        btree_reset_io(frota.shards[s]);
+    }
     
-    printf("\nCarregando veiculos do arquivo veiculos.dat...\n");
-    printf("Total de registros: %d\n\n", num_registros);
+    ReplayEstatistica estatisticas[NUM_OPS];
+    memset(estatisticas, 0, sizeof(estatisticas));
     
-    fseek(tree->data_file, 0, SEEK_SET);
+    Veiculo *varredura = (Veiculo*)malloc(SCAN_MAX_REGISTROS * sizeof(Veiculo));
+    char argumento[sizeof(Veiculo)];
+    TraceCabecalho registro;
+    double inicio = agora_segundos();
+    long total = 0;
     
-    int carregados = 0;
+    printf("Replay de %s (%s)...\n", trace_file, ritmo ? "ritmo gravado" : "maxima velocidade");
     
-    for (int rrn = 0; rrn < num_registros; rrn++) {
-        Veiculo veiculo;
-        memset(&veiculo, 0, sizeof(Veiculo));
-        
-        size_t registros_lidos = fread(&veiculo, tamanho_registro, 1, tree->data_file);
-        
-        if (registros_lidos != 1) {
-            continue;
+    while (fread(&registro, sizeof(registro), 1, trace) == 1) {
+        if (registro.tamanho > sizeof(argumento) ||
+            fread(argumento, 1, registro.tamanho, trace) != registro.tamanho) {
+            break;
         }
+        if (registro.op == 0 || registro.op >= NUM_OPS) continue;
         
-        veiculo.placa[TAMANHO_PLACA - 1] = '\0';
-        veiculo.modelo[TAMANHO_MODELO - 1] = '\0';
-        veiculo.marca[TAMANHO_MARCA - 1] = '\0';
-        veiculo.categoria[TAMANHO_CATEGORIA - 1] = '\0';
-        veiculo.status[TAMANHO_STATUS - 1] = '\0';
+        if (ritmo) {
+            replay_aguardar(inicio + registro.timestamp_ns / 1e9);
+        }
         
-        normalizar_placa(veiculo.placa);
+        long antes[4];
+        replay_contadores(&frota, antes);
+        double t0 = agora_segundos();
         
-        int placa_valida = 0;
-        for (int i = 0; i < TAMANHO_PLACA; i++) {
-            if ((veiculo.placa[i] >= 'A' && veiculo.placa[i] <= 'Z') ||
-                (veiculo.placa[i] >= '0' && veiculo.placa[i] <= '9')) {
-                placa_valida = 1;
+        Veiculo veiculo;
+        switch (registro.op) {
+            case OP_BUSCAR:
+                argumento[TAMANHO_PLACA - 1] = '\0';
+                frota_buscar(&frota, argumento, &veiculo);
+                break;
+            case OP_INSERIR:
+                memcpy(&veiculo, argumento, sizeof(Veiculo));
+                sharded_insert(&frota, &veiculo);
+                break;
+            case OP_ATUALIZAR:
+                memcpy(&veiculo, argumento, sizeof(Veiculo));
+                frota_atualizar(&frota, &veiculo);
+                break;
+            case OP_REMOVER:
+                argumento[TAMANHO_PLACA - 1] = '\0';
+                // Remocao do menu: refaz tambem o texto do shard, como btree_remove
+                if (frota_remover(&frota, argumento) == RESP_OK && (registro.marcas & TRACE_COM_TEXTO)) {
+                    BTree *tree = sharded_route(&frota, argumento);
+                    pthread_mutex_lock(&tree->trava);
+                    text_rebuild_file(tree);
+                    pthread_mutex_unlock(&tree->trava);
+                }
+                break;
+            case OP_VARRER: {
+                uint16_t limite;
+                memcpy(&limite, argumento + TAMANHO_PLACA, sizeof(limite));
+                argumento[TAMANHO_PLACA - 1] = '\0';
+                if (limite == 0 || limite > SCAN_MAX_REGISTROS) limite = SCAN_MAX_REGISTROS;
+                frota_varrer(&frota, argumento, limite, varredura);
                 break;
             }
+            case OP_RECONSTRUIR:
+                sharded_rebuild_text(&frota);
+                break;
+            case OP_RETIRAR:
+                argumento[TAMANHO_CATEGORIA - 1] = '\0';
+                frota_retirar(&frota, argumento, &veiculo);
+                break;
+            case OP_DEVOLVER:
+                argumento[TAMANHO_PLACA - 1] = '\0';
+                frota_devolver(&frota, argumento, &veiculo);
+                break;
         }
         
-        if (!placa_valida) {
-            continue;
-        }
-        
-        if (strstr(veiculo.status, "REMOVIDO") != NULL) {
-            continue;
+        ReplayEstatistica *e = &estatisticas[registro.op];
+        if (e->quantidade == e->capacidade) {
+            e->capacidade = e->capacidade > 0 ? e->capacidade * 2 : 1024;
+            e->latencias = (double*)realloc(e->latencias, e->capacidade * sizeof(double));
+            e->gravadas = (double*)realloc(e->gravadas, e->capacidade * sizeof(double));
         }
-        
-        btree_insert(tree, veiculo.placa, rrn);
-        text_append_veiculo(tree, &veiculo, rrn);
-        carregados++;
+        e->gravadas[e->quantidade] = registro.duracao_us / 1e6;
+        e->latencias[e->quantidade++] = agora_segundos() - t0;
+        long depois[4];
+        replay_contadores(&frota, depois);
+        e->leituras_pagina += depois[0] - antes[0];
+        e->escritas_pagina += depois[1] - antes[1];
+        e->leituras_registro += depois[2] - antes[2];
+        e->escritas_registro += depois[3] - antes[3];
+        total++;
     }
     
-    printf("Veiculos carregados: %d\n\n", carregados);
+    double duracao = agora_segundos() - inicio;
+    printf("%ld operacoes em %.3f s (%.0f op/s)\n", total, duracao, duracao > 0 ? total / duracao : 0);
+    replay_salvar(estatisticas, saida);
+    
+    for (int op = 0; op < NUM_OPS; op++) {
+        free(estatisticas[op].latencias);
+        free(estatisticas[op].gravadas);
+    }
+    free(varredura);
+    fclose(trace);
+    for (int s = 0; s < frota.num_shards; s++) {
+        btree_close(frota.shards[s]);
+    }
+    return 0;
 }
 
-BTree* btree_create(const char *index_file, const char *data_file, const char *text_file) {
-    BTree *tree = (BTree*)malloc(sizeof(BTree));
-    strcpy(tree->index_filename, index_file);
-    strcpy(tree->data_filename, data_file);
-    strcpy(tree->text_filename, text_file);
+typedef struct ReplayResultado {
+    char operacao[16];
+    int quantidade;
+    double metricas[8];
+} ReplayResultado;
+
+int replay_ler_resultado(const char *arquivo_resultado, ReplayResultado *resultados) {
+    FILE *arquivo = fopen(arquivo_resultado, "r");
+    if (!arquivo) return -1;
     
-    tree->index_file = fopen(index_file, "wb+");
-    if (!tree->index_file) {
-        free(tree);
-        return NULL;
+    int n = 0;
+    ReplayResultado *r = &resultados[0];
+    while (n < NUM_OPS &&
+           fscanf(arquivo, "%15s %d %lf %lf %lf %lf %lf %lf %lf %lf", r->operacao, &r->quantidade,
+                  &r->metricas[0], &r->metricas[1], &r->metricas[2], &r->metricas[3],
+                  &r->metricas[4], &r->metricas[5], &r->metricas[6], &r->metricas[7]) == 10) {
+        r = &resultados[++n];
     }
+    fclose(arquivo);
+    return n;
+}
+
+// Compara duas execucoes de replay (ex.: antes e depois de uma mudanca no motor)
+int replay_comparar(const char *arquivo_a, const char *arquivo_b) {
+    const char *nomes_metricas[8] = {
+        "p50(us)", "p90(us)", "p99(us)", "max(us)", "pag.lid", "pag.esc", "reg.lid", "reg.esc"
+    };
+    ReplayResultado a[NUM_OPS + 1];
+    ReplayResultado b[NUM_OPS + 1];
+    int na = replay_ler_resultado(arquivo_a, a);
+    int nb = replay_ler_resultado(arquivo_b, b);
     
-    tree->data_file = fopen(data_file, "rb+");
-    if (!tree->data_file) {
-        tree->data_file = fopen(data_file, "wb+");
+    if (na < 0 || nb < 0) {
+        printf("Nao foi possivel ler os resultados!\n");
+        return 1;
     }
     
-    tree->text_file = fopen(text_file, "w");
-    if (!tree->text_file) {
-        fclose(tree->index_file);
-        fclose(tree->data_file);
-        free(tree);
-        return NULL;
+    printf("%-12s %-9s %12s %12s %9s\n", "operacao", "metrica", "A", "B", "delta");
+    for (int i = 0; i < na; i++) {
+        for (int j = 0; j < nb; j++) {
+            if (strcmp(a[i].operacao, b[j].operacao) != 0) continue;
+            
+            if (a[i].quantidade != b[j].quantidade) {
+                printf("%-12s quantidade diferente: %d x %d\n", a[i].operacao, a[i].quantidade, b[j].quantidade);
+            }
+            for (int m = 0; m < 8; m++) {
+                double va = a[i].metricas[m];
+                double vb = b[j].metricas[m];
+                if (va == 0 && vb == 0) continue;
+                printf("%-12s %-9s %12.2f %12.2f %+8.1f%%\n", a[i].operacao, nomes_metricas[m],
+                       va, vb, va != 0 ? (vb - va) / va * 100.0 : 100.0);
+            }
+        }
     }
-    
-    fprintf(tree->text_file, "========================================\n");
-    fprintf(tree->text_file, "   SISTEMA DE LOCACAO DE VEICULOS\n");
-    fprintf(tree->text_file, "========================================\n\n");
-    fflush(tree->text_file);
-    
-    tree->root_rrn = -1;
-    tree->next_rrn = 0;
-    tree->page_queue = queue_create();
-    
-    fwrite(&tree->root_rrn, sizeof(int), 1, tree->index_file);
-    fwrite(&tree->next_rrn, sizeof(int), 1, tree->index_file);
-    fflush(tree->index_file);
-    
-    printf("Sistema criado! (M=%d, Cache=%d paginas)\n", M, P);
-    
-    btree_load_from_data_file(tree);
-    
-    return tree;
+    return 0;
 }
 
-BTree* btree_load(const char *index_file, const char *data_file, const char *text_file) {
-    BTree *tree = (BTree*)malloc(sizeof(BTree));
-    strcpy(tree->index_filename, index_file);
-    strcpy(tree->data_filename, data_file);
-    strcpy(tree->text_filename, text_file);
-    
-    tree->index_file = fopen(index_file, "rb+");
-    if (!tree->index_file) {
-        free(tree);
-        return NULL;
+// Benchmark de insercao: motor direto x bufferizado, sobre placas unicas em
+// ordem embaralhada e arquivos de rascunho (bench_*.idx)
+void bench_placa(int i, char *placa) {
+    long k = ((long)i * 1000003L + 12345L) % 175760000L;
+    long letras = k / 10000;
+    placa[0] = 'A' + (letras / 676) % 26;
+    placa[1] = 'A' + (letras / 26) % 26;
+    placa[2] = 'A' + letras % 26;
+    long numero = k % 10000;
+    for (int j = 6; j >= 3; j--) {
+        placa[j] = '0' + numero % 10;
+        numero /= 10;
     }
+    placa[7] = '\0';
+}
+
+typedef struct BenchResultado {
+    double insercoes_por_segundo;
+    double leituras_por_insercao;
+    double escritas_por_insercao;
+    double leituras_por_consulta;
+    int falhas;
+} BenchResultado;
+
+bool bench_executar(int n, int consultas, bool bufferizado, BenchResultado *resultado) {
+    const char *index_file = bufferizado ? "bench_bufferizado.idx" : "bench_direto.idx";
     
-    tree->data_file = fopen(data_file, "rb+");
-    if (!tree->data_file) {
-        fclose(tree->index_file);
-        free(tree);
-        return NULL;
+    FILE *vazio = fopen("bench.dat", "wb");
+    if (!vazio) return false;
+    fclose(vazio);
+    
+    BTree *tree = btree_create(index_file, "bench.dat", "bench.txt");
+    if (!tree) return false;
+    if (bufferizado && !btree_set_buffered(tree, true)) {
+        btree_close(tree);
+        return false;
     }
+    btree_reset_io(tree);
     
-    tree->text_file = fopen(text_file, "a");
-    if (!tree->text_file) {
-        fclose(tree->index_file);
-        fclose(tree->data_file);
-        free(tree);
-        return NULL;
+    char placa[TAMANHO_PLACA];
+    double inicio = agora_segundos();
+    for (int i = 0; i < n; i++) {
+        bench_placa(i, placa);
+        btree_insert(tree, placa, i);
     }
+    double duracao = agora_segundos() - inicio;
     
-    fread(&tree->root_rrn, sizeof(int), 1, tree->index_file);
-    fread(&tree->next_rrn, sizeof(int), 1, tree->index_file);
-    tree->page_queue = queue_create();
+    resultado->insercoes_por_segundo = duracao > 0 ? n / duracao : 0;
+    resultado->leituras_por_insercao = (double)(tree->leituras_pagina + tree->leituras_buffer) / n;
+    resultado->escritas_por_insercao = (double)(tree->escritas_pagina + tree->escritas_buffer) / n;
     
-    printf("Sistema carregado! (Raiz RNN=%d)\n", tree->root_rrn);
-    return tree;
+    btree_reset_io(tree);
+    resultado->falhas = 0;
+    srand(42);
+    for (int c = 0; c < consultas; c++) {
+        int i = (int)(((long)rand() * RAND_MAX + rand()) % n);
+        bench_placa(i, placa);
+        if (btree_search_internal(tree, tree->root_rrn, placa) != i) {
+            resultado->falhas++;
+        }
+    }
+    resultado->leituras_por_consulta = consultas > 0
+        ? (double)(tree->leituras_pagina + tree->leituras_buffer) / consultas : 0;
+    
+    btree_set_buffered(tree, false);
+    btree_close(tree);
+    remove(index_file);
+    remove("bench.dat");
+    remove("bench.dat.pool");
+    remove("bench.txt");
+    return true;
 }
 
-void btree_close(BTree *tree) {
-    if (tree) {
-        PageQueueNode *current = tree->page_queue->front;
-        while (current != NULL) {
-            if (current->page->modified) {
-                btree_write_node(tree, current->page, current->rrn);
-            }
-            current = current->next;
-        }
-        
-        if (tree->index_file) {
-            fseek(tree->index_file, 0, SEEK_SET);
-            fwrite(&tree->root_rrn, sizeof(int), 1, tree->index_file);
-            fwrite(&tree->next_rrn, sizeof(int), 1, tree->index_file);
-            fclose(tree->index_file);
-        }
-        
-        if (tree->data_file) {
-            fclose(tree->data_file);
-        }
-        
-        if (tree->text_file) {
-            fclose(tree->text_file);
-        }
-        
-        queue_destroy(tree->page_queue);
-        free(tree);
-        printf("Sistema fechado!\n");
+int bench_insercao(int n, int consultas) {
+    if (n <= 0) return 1;
+    
+    BenchResultado direto, bufferizado;
+    if (!bench_executar(n, consultas, false, &direto) ||
+        !bench_executar(n, consultas, true, &bufferizado)) {
+        printf("Falha ao criar arquivos do benchmark!\n");
+        return 1;
     }
+    
+    printf("\n=== Benchmark de insercao (%d chaves, %d consultas, M=%d, cache=%d) ===\n",
+           n, consultas, M, P);
+    printf("%-12s %12s %12s %12s %12s %8s\n", "motor", "ins/s", "leit/ins", "escr/ins", "leit/cons", "falhas");
+    printf("%-12s %12.0f %12.2f %12.2f %12.2f %8d\n", "direto",
+           direto.insercoes_por_segundo, direto.leituras_por_insercao,
+           direto.escritas_por_insercao, direto.leituras_por_consulta, direto.falhas);
+    printf("%-12s %12.0f %12.2f %12.2f %12.2f %8d\n", "bufferizado",
+           bufferizado.insercoes_por_segundo, bufferizado.leituras_por_insercao,
+           bufferizado.escritas_por_insercao, bufferizado.leituras_por_consulta, bufferizado.falhas);
+    
+    return direto.falhas + bufferizado.falhas > 0 ? 1 : 0;
 }
 
-void menu_principal(BTree *tree) {
+void menu_principal(ShardedBTree *frota) {
     int opcao;
     char buffer[100];
     
@@ -756,6 +4482,12 @@ void menu_principal(BTree *tree) {
         printf("3. Remover veiculo\n");
         printf("4. Imprimir arvore e cache\n");
         printf("5. Reconstruir arquivo texto\n");
+        printf("6. Backup a quente (snapshot)\n");
+        printf("7. Exportar frota (texto, CSV ou JSON Lines)\n");
+        printf("8. Alternar modo de insercao (%s)\n",
+               frota->shards[0]->bufferizado ? "bufferizado" : "direto");
+        printf("9. Retirar veiculo disponivel por categoria\n");
+        printf("10. Devolver veiculo\n");
         printf("0. Sair\n");
         printf("Escolha: ");
         
@@ -781,36 +4513,90 @@ void menu_principal(BTree *tree) {
                 veiculo.quilometragem = ler_inteiro("Quilometragem: ");
                 ler_string(veiculo.status, TAMANHO_STATUS, "Status: ");
     
-                int rrn = data_insert_veiculo(tree, &veiculo);
-                btree_insert(tree, veiculo.placa, rrn);
-                printf("Veiculo inserido com sucesso!\n");
+                if (sharded_insert(frota, &veiculo)) {
+                    printf("Veiculo inserido com sucesso!\n");
+                } else {
+                    printf("Veiculo nao inserido: placa ja cadastrada ou falha na gravacao!\n");
+                }
                 break;
             }
             
             case 2: {
                 char placa[100];
                 ler_string(placa, sizeof(placa), "Placa: ");
-                btree_search(tree, placa);
+                sharded_search(frota, placa);
                 break;
             }
             
             case 3: {
                 char placa[100];
                 ler_string(placa, sizeof(placa), "Placa: ");
-                btree_remove(tree, placa);
+                sharded_remove(frota, placa);
                 break;
             }
             
             case 4:
-                btree_print(tree);
+                sharded_print(frota);
                 break;
                 
             case 5:
                 printf("Reconstruindo arquivo texto...\n");
-                text_rebuild_file(tree);
+                sharded_rebuild_text(frota);
                 printf("Arquivo veiculos.txt atualizado!\n");
                 break;
                 
+            case 6:
+                if (sharded_backup_start(frota)) {
+                    printf("Backup iniciado em segundo plano (arquivos .dat.bak)\n");
+                } else {
+                    printf("Falha ao iniciar backup!\n");
+                }
+                break;
+                
+            case 7: {
+                int formato = ler_inteiro("Formato (0 = texto, 1 = CSV, 2 = JSON Lines): ");
+                int ordem = ler_inteiro("Ordem (0 = RRN, 1 = placa): ");
+                if (formato < EXPORT_TEXTO || formato > EXPORT_JSONL) formato = EXPORT_TEXTO;
+                sharded_export(frota, formato, ordem == 1);
+                break;
+            }
+            
+            case 8:
+                sharded_set_buffered(frota, !frota->shards[0]->bufferizado);
+                printf("Modo de insercao: %s\n", frota->shards[0]->bufferizado ? "bufferizado" : "direto");
+                break;
+                
+            case 9: {
+                char categoria[TAMANHO_CATEGORIA];
+                Veiculo veiculo;
+                memset(categoria, 0, sizeof(categoria));
+                ler_string(categoria, TAMANHO_CATEGORIA, "Categoria: ");
+                if (frota_retirar(frota, categoria, &veiculo) == RESP_OK) {
+                    printf("Veiculo retirado:\n");
+                    data_print_veiculo(&veiculo);
+                } else {
+                    printf("Nenhum veiculo disponivel na categoria '%s'!\n", categoria);
+                }
+                break;
+            }
+            
+            case 10: {
+                char placa[100];
+                Veiculo veiculo;
+                ler_string(placa, sizeof(placa), "Placa: ");
+                switch (frota_devolver(frota, placa, &veiculo)) {
+                    case RESP_OK:
+                        printf("Veiculo devolvido e disponivel novamente!\n");
+                        break;
+                    case RESP_ERRO:
+                        printf("Veiculo '%s' nao esta alugado!\n", placa);
+                        break;
+                    default:
+                        printf("Placa '%s' nao encontrada!\n", placa);
+                }
+                break;
+            }
+                
             case 0:
                 printf("Salvando e encerrando...\n");
                 break;
@@ -821,29 +4607,122 @@ void menu_principal(BTree *tree) {
     } while(opcao != 0);
 }
 
-int main() {
-    BTree *tree = NULL;
+void uso() {
+    printf("Uso:\n");
+    printf("  locadora                                   menu interativo\n");
+    printf("  locadora --servidor [socket] [particionado]\n");
+    printf("  locadora --carga [socket] [requisicoes] [conexoes] [pipeline] [%%escrita]\n");
+    printf("  (escritas so criam, alteram e removem veiculos proprios; padrao 0%%)\n");
+    printf("  locadora --replay trace.bin [resultado.rep] [ritmo]\n");
+    printf("  locadora --comparar a.rep b.rep\n");
+    printf("  (LOCADORA_TRACE=arquivo grava um trace de qualquer modo)\n");
+    printf("  locadora --exportar texto|csv|jsonl [placa] [particionado]\n");
+    printf("  locadora --compactar [veiculos.dat|particionado]   converte para o formato compacto\n");
+    printf("  locadora --expandir [veiculos.dat|particionado]    volta ao formato fixo de 88 bytes\n");
+    printf("  locadora --expurgar                               tira os removidos de cada shard e refaz os indices\n");
+    printf("  locadora --bench-insercao [chaves] [consultas]   motor direto x bufferizado\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        const char *caminho = argc > 2 ? argv[2] : SERVIDOR_SOCKET_PADRAO;
+        
+        if (strcmp(argv[1], "--servidor") == 0) {
+            bool particionado = argc > 3 && strcmp(argv[3], "particionado") == 0;
+            ShardedBTree *frota = sharded_open(particionado ? MAX_SHARDS : 1, SHARD_POR_PREFIXO, false);
+            if (!frota) return 1;
+            int resultado = servidor_iniciar(frota, caminho);
+            sharded_close(frota);
+            return resultado;
+        }
+        
+        if (strcmp(argv[1], "--replay") == 0 && argc > 2) {
+            const char *saida = argc > 3 ? argv[3] : NULL;
+            bool ritmo = argc > 4 && strcmp(argv[4], "ritmo") == 0;
+            return replay_executar(argv[2], saida, ritmo);
+        }
+        
+        if (strcmp(argv[1], "--comparar") == 0 && argc > 3) {
+            return replay_comparar(argv[2], argv[3]);
+        }
+        
+        if (strcmp(argv[1], "--exportar") == 0 && argc > 2) {
+            int formato = strcmp(argv[2], "csv") == 0 ? EXPORT_CSV
+                        : strcmp(argv[2], "jsonl") == 0 ? EXPORT_JSONL : EXPORT_TEXTO;
+            bool ordem_indice = false;
+            bool particionado = false;
+            for (int i = 3; i < argc; i++) {
+                if (strcmp(argv[i], "placa") == 0) ordem_indice = true;
+                if (strcmp(argv[i], "particionado") == 0) particionado = true;
+            }
+            ShardedBTree *frota = sharded_open(particionado ? MAX_SHARDS : 1, SHARD_POR_PREFIXO, false);
+            if (!frota) return 1;
+            sharded_export(frota, formato, ordem_indice);
+            sharded_close(frota);
+            return 0;
+        }
+        
+        if (strcmp(argv[1], "--compactar") == 0 || strcmp(argv[1], "--expandir") == 0) {
+            const char *data_file = argc > 2 ? argv[2] : "veiculos.dat";
+            int formato = strcmp(argv[1], "--compactar") == 0 ? FORMATO_COMPACTO : FORMATO_FIXO;
+            if (strcmp(data_file, "particionado") == 0) {
+                return sharded_convert(formato) ? 0 : 1;
+            }
+            return data_convert_file(data_file, formato, false) ? 0 : 1;
+        }
+        
+        if (strcmp(argv[1], "--expurgar") == 0) {
+            return sharded_purge() ? 0 : 1;
+        }
+        
+        if (strcmp(argv[1], "--bench-insercao") == 0) {
+            return bench_insercao(argc > 2 ? atoi(argv[2]) : 200000,
+                                  argc > 3 ? atoi(argv[3]) : 20000);
+        }
+        
+        if (strcmp(argv[1], "--carga") == 0) {
+            return carga_executar(caminho,
+                                  argc > 3 ? atoi(argv[3]) : 100000,
+                                  argc > 4 ? atoi(argv[4]) : 4,
+                                  argc > 5 ? atoi(argv[5]) : 32,
+                                  argc > 6 ? atoi(argv[6]) : 0);
+        }
+        
+        uso();
+        return 1;
+    }
+    
+    ShardedBTree *frota = NULL;
     int opcao;
     char buffer[100];
     
     printf("=== SISTEMA DE LOCACAO DE VEICULOS ===\n");
     printf("1. Criar novo indice (carrega veiculos.dat existente)\n");
     printf("2. Carregar indice existente\n");
+    printf("3. Criar indice particionado (divide veiculos.dat em shards)\n");
+    printf("4. Carregar indice particionado\n");
     printf("Escolha: ");
     
     fgets(buffer, sizeof(buffer), stdin);
     opcao = atoi(buffer);
     
     if (opcao == 1) {
-        tree = btree_create("btree_M.idx", "veiculos.dat", "veiculos.txt");
+        frota = sharded_open(1, SHARD_POR_PREFIXO, true);
+    } else if (opcao == 3) {
+        int num_shards = ler_inteiro("Numero de shards: ");
+        int modo = ler_inteiro("Particionar por (0 = prefixo da placa, 1 = hash): ");
+        if (num_shards < 2) num_shards = 2;
+        frota = sharded_open(num_shards, modo == 1 ? SHARD_POR_HASH : SHARD_POR_PREFIXO, true);
+    } else if (opcao == 4) {
+        frota = sharded_open(MAX_SHARDS, SHARD_POR_PREFIXO, false);
     } else {
-        tree = btree_load("btree_M.idx", "veiculos.dat", "veiculos.txt");
+        frota = sharded_open(1, SHARD_POR_PREFIXO, false);
     }
     
-    if (tree) {
-        menu_principal(tree);
-        btree_close(tree);
+    if (frota) {
+        menu_principal(frota);
+        sharded_close(frota);
     }
     
     return 0;
-}
\ No newline at end of file
+}